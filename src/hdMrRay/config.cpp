@@ -10,6 +10,7 @@ TF_INSTANTIATE_SINGLETON(HdMrRayConfig);
 
 HdMrRayConfig::HdMrRayConfig()
     : samplesPerPixel(1u)
+    , samplesPerPass(1u)
     , tileSize(64u)
     , threads(std::thread::hardware_concurrency())
 {
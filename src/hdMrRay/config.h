@@ -14,6 +14,10 @@ public:
     /// Amount of pixel samples to take
     unsigned int samplesPerPixel;
 
+    /// Amount of pixel samples to take in each progressive pass. The
+    /// viewport is updated as the tiles of every pass finish.
+    unsigned int samplesPerPass;
+
     /// Size of render tiles
     unsigned int tileSize;
 
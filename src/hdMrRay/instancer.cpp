@@ -0,0 +1,138 @@
+#include "instancer.h"
+
+#include "pxr/base/gf/quatd.h"
+#include "pxr/base/vt/types.h"
+#include "pxr/imaging/hd/renderIndex.h"
+#include "pxr/imaging/hd/sceneDelegate.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+HdMrRayInstancer::HdMrRayInstancer(HdSceneDelegate *delegate, SdfPath const &id)
+    : HdInstancer(delegate, id)
+{
+}
+
+void
+HdMrRayInstancer::Sync(
+    HdSceneDelegate *sceneDelegate, HdRenderParam *renderParam,
+    HdDirtyBits *dirtyBits)
+{
+    _UpdateInstancer(sceneDelegate, dirtyBits);
+
+    if (HdChangeTracker::IsAnyPrimvarDirty(*dirtyBits, GetId())) {
+        _SyncPrimvars(sceneDelegate, *dirtyBits);
+    }
+}
+
+void
+HdMrRayInstancer::_SyncPrimvars(HdSceneDelegate *delegate, HdDirtyBits dirtyBits)
+{
+    SdfPath const &id = GetId();
+    std::lock_guard<std::mutex> lock(_primvarsLock);
+    for (HdPrimvarDescriptor const &primvar:
+         delegate->GetPrimvarDescriptors(id, HdInterpolationInstance))
+    {
+        if (HdChangeTracker::IsPrimvarDirty(dirtyBits, id, primvar.name)) {
+            _primvars[primvar.name] = delegate->Get(id, primvar.name);
+        }
+    }
+}
+
+// Returns the instance rate primvar with the given name, if it holds an
+// array of T
+template <typename T>
+static bool
+_GetPrimvar(
+    TfHashMap<TfToken, VtValue, TfToken::HashFunctor> const &primvars,
+    TfToken const &name, VtArray<T> *result)
+{
+    auto it = primvars.find(name);
+    if (it == primvars.end() || !it->second.IsHolding<VtArray<T>>()) {
+        return false;
+    }
+    *result = it->second.UncheckedGet<VtArray<T>>();
+    return true;
+}
+
+VtMatrix4dArray
+HdMrRayInstancer::ComputeInstanceTransforms(SdfPath const &prototypeId)
+{
+    GfMatrix4d instancerTransform
+        = GetDelegate()->GetInstancerTransform(GetId());
+    VtIntArray instanceIndices
+        = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+
+    // Each instance is placed by its own transform, then scale, rotation and
+    // translation, all relative to the instancer
+    VtMatrix4dArray transforms(instanceIndices.size());
+    {
+        std::lock_guard<std::mutex> lock(_primvarsLock);
+        VtVec3fArray translations, scales;
+        VtQuathArray rotationsH;
+        VtQuatfArray rotationsF;
+        VtVec4fArray rotationsV;
+        VtMatrix4dArray instanceTransforms;
+        _GetPrimvar(_primvars, GetInstanceTranslationsToken(), &translations);
+        _GetPrimvar(_primvars, GetInstanceScalesToken(), &scales);
+        _GetPrimvar(_primvars, GetInstanceRotationsToken(), &rotationsH)
+            || _GetPrimvar(_primvars, GetInstanceRotationsToken(), &rotationsF)
+            || _GetPrimvar(_primvars, GetInstanceRotationsToken(), &rotationsV);
+        _GetPrimvar(
+            _primvars, GetInstanceTransformsToken(), &instanceTransforms);
+
+        for (size_t i = 0; i < instanceIndices.size(); ++i) {
+            int index = instanceIndices[i];
+            GfMatrix4d transform(1);
+            if (index < (int)instanceTransforms.size()) {
+                transform = instanceTransforms[index];
+            }
+            if (index < (int)scales.size()) {
+                GfMatrix4d scale(1);
+                scale.SetScale(GfVec3d(scales[index]));
+                transform *= scale;
+            }
+            GfQuatd rotation(1);
+            if (index < (int)rotationsH.size()) {
+                rotation = GfQuatd(rotationsH[index]);
+            } else if (index < (int)rotationsF.size()) {
+                rotation = GfQuatd(rotationsF[index]);
+            } else if (index < (int)rotationsV.size()) {
+                GfVec4f const &v = rotationsV[index];
+                rotation = GfQuatd(v[0], v[1], v[2], v[3]);
+            }
+            transform *= GfMatrix4d(1).SetRotate(rotation);
+            if (index < (int)translations.size()) {
+                GfMatrix4d translate(1);
+                translate.SetTranslate(GfVec3d(translations[index]));
+                transform *= translate;
+            }
+            transforms[i] = transform * instancerTransform;
+        }
+    }
+
+    if (GetParentId().IsEmpty()) {
+        return transforms;
+    }
+
+    // Nested instancers repeat every instance of this one once per instance
+    // of the parent
+    HdInstancer *parent
+        = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+    if (!TF_VERIFY(parent)) {
+        return transforms;
+    }
+    VtMatrix4dArray parentTransforms
+        = static_cast<HdMrRayInstancer *>(parent)->ComputeInstanceTransforms(
+            GetId());
+    VtMatrix4dArray nestedTransforms(
+        transforms.size() * parentTransforms.size());
+    for (size_t p = 0; p < parentTransforms.size(); ++p) {
+        for (size_t i = 0; i < transforms.size(); ++i) {
+            nestedTransforms[p * transforms.size() + i]
+                = transforms[i] * parentTransforms[p];
+        }
+    }
+    return nestedTransforms;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,42 @@
+#ifndef HD_MR_RAY_INSTANCER_H
+#define HD_MR_RAY_INSTANCER_H
+
+#include "pxr/base/tf/hashmap.h"
+#include "pxr/base/vt/array.h"
+#include "pxr/imaging/hd/instancer.h"
+#include "pxr/pxr.h"
+
+#include <mutex>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// Resolves the per instance transforms of a Hydra instancer, so prototype
+/// meshes can be placed as mrRay instances
+class HdMrRayInstancer final : public HdInstancer
+{
+public:
+    HdMrRayInstancer(HdSceneDelegate *delegate, SdfPath const &id);
+
+    virtual ~HdMrRayInstancer() = default;
+
+    virtual void Sync(
+        HdSceneDelegate *sceneDelegate, HdRenderParam *renderParam,
+        HdDirtyBits *dirtyBits) override;
+
+    /// Returns the transform of every instance of the given prototype,
+    /// including those of any parent instancers
+    VtMatrix4dArray ComputeInstanceTransforms(SdfPath const &prototypeId);
+
+private:
+    void _SyncPrimvars(HdSceneDelegate *delegate, HdDirtyBits dirtyBits);
+
+    TfHashMap<TfToken, VtValue, TfToken::HashFunctor> _primvars;
+    std::mutex _primvarsLock;
+
+    HdMrRayInstancer(const HdMrRayInstancer &) = delete;
+    HdMrRayInstancer &operator=(const HdMrRayInstancer &) = delete;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // HD_MR_RAY_INSTANCER_H
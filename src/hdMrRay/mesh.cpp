@@ -1,8 +1,12 @@
 #include "mesh.h"
+#include "instancer.h"
 #include "renderParam.h"
+#include <mrRay/geom/instance.h>
 #include <mrRay/material/material.h>
 #include <mrRay/matrix.h>
 
+#include "pxr/imaging/hd/renderIndex.h"
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 HdMrRayMesh::HdMrRayMesh(const SdfPath &id)
@@ -11,12 +15,19 @@ HdMrRayMesh::HdMrRayMesh(const SdfPath &id)
     , _transform()
     , _points()
     , _rayMesh()
+    , _material()
+    , _hittableHandle(mrRay::INVALID_HITTABLE_HANDLE)
 {
 }
 
 void
 HdMrRayMesh::Finalize(HdRenderParam *renderParam)
 {
+    if (_hittableHandle == mrRay::INVALID_HITTABLE_HANDLE) return;
+    auto *mrRayRenderParam = static_cast<HdMrRayRenderParam *>(renderParam);
+    mrRayRenderParam->AcquireSceneForEdit()->removeHittables(_hittableHandle);
+    _hittableHandle = mrRay::INVALID_HITTABLE_HANDLE;
+    _rayMesh = nullptr;
 }
 
 HdDirtyBits
@@ -59,29 +70,71 @@ HdMrRayMesh::Sync(
     mrRay::Scene *scene = mrRayRenderParam->AcquireSceneForEdit();
 
     SdfPath const &id = GetId();
-    if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) {
+    _UpdateInstancer(sceneDelegate, dirtyBits);
+    HdInstancer::_SyncInstancerAndParents(
+        sceneDelegate->GetRenderIndex(), GetInstancerId());
+
+    size_t previousPointCount = _points.size();
+    bool pointsDirty
+        = HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points);
+    bool topologyDirty = HdChangeTracker::IsTopologyDirty(*dirtyBits, id);
+    bool transformDirty = HdChangeTracker::IsTransformDirty(*dirtyBits, id);
+    bool colourDirty = HdChangeTracker::IsPrimvarDirty(
+        *dirtyBits, id, HdTokens->displayColor);
+    if (pointsDirty) {
         VtValue value = GetPoints(sceneDelegate);
         _points = value.Get<VtVec3fArray>();
     }
-    if (HdChangeTracker::IsTopologyDirty(*dirtyBits, id)) {
+    if (topologyDirty) {
         _topology = GetMeshTopology(sceneDelegate);
     }
-    if (HdChangeTracker::IsTransformDirty(*dirtyBits, id)) {
+    if (transformDirty) {
         _transform = sceneDelegate->GetTransform(id).GetTranspose();
     }
 
-    std::shared_ptr<mrRay::Lambertian> meshMaterial;
-    if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->displayColor)) {
+    HdInstancer *instancer = nullptr;
+    if (!GetInstancerId().IsEmpty()) {
+        instancer = sceneDelegate->GetRenderIndex().GetInstancer(
+            GetInstancerId());
+    }
+
+    // When only the points or the transform have changed, the existing
+    // mesh is deformed in place and its BVH refitted, which is much
+    // cheaper than building a new one. Instances hold their transforms
+    // themselves, so instanced meshes only take this path for points.
+    bool deformOnly
+        = _rayMesh && (pointsDirty || transformDirty) && !topologyDirty
+       && _points.size() == previousPointCount
+       && !HdChangeTracker::IsInstancerDirty(*dirtyBits, id) && !colourDirty
+       && !(instancer && transformDirty);
+    if (deformOnly) {
+        std::vector<mrRay::Vec3> positions;
+        positions.reserve(_points.size());
+        for (auto const &point: _points) {
+            positions.emplace_back(point[0], point[1], point[2]);
+        }
+        _rayMesh->setPositions(
+            positions,
+            instancer ? mrRay::Mat4::identity() : _ToMat4(_transform));
+        scene->markBoundsDirty(_hittableHandle);
+        *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
+        return;
+    }
+
+    // The dirty bits are cleared after every sync, so the material is kept
+    // for rebuilds where the colour hasn't changed
+    if (!_material || colourDirty) {
+        _material = nullptr;
         VtValue value = GetPrimvar(sceneDelegate, HdTokens->displayColor);
         for (auto const &color: value.Get<VtVec3fArray>()) {
-            meshMaterial = std::make_shared<mrRay::Lambertian>(
+            _material = std::make_shared<mrRay::Lambertian>(
                 mrRay::Colour(color[0], color[1], color[2]));
             break;
         }
-    }
-    if (!meshMaterial) {
-        meshMaterial
-            = std::make_shared<mrRay::Lambertian>(mrRay::Colour(0.9, 0.9, 0.9));
+        if (!_material) {
+            _material = std::make_shared<mrRay::Lambertian>(
+                mrRay::Colour(0.9, 0.9, 0.9));
+        }
     }
 
     mrRay::RawMeshInfo rawMeshInfo;
@@ -102,28 +155,58 @@ HdMrRayMesh::Sync(
         indicesIndex += count;
     }
 
-    _rayMesh = std::make_shared<mrRay::Mesh>(
-        rawMeshInfo,
-        mrRay::Mat4(
-            _transform[0][0],
-            _transform[0][1],
-            _transform[0][2],
-            _transform[0][3],
-            _transform[1][0],
-            _transform[1][1],
-            _transform[1][2],
-            _transform[1][3],
-            _transform[2][0],
-            _transform[2][1],
-            _transform[2][2],
-            _transform[2][3],
-            _transform[3][0],
-            _transform[3][1],
-            _transform[3][2],
-            _transform[3][3]),
-        false,
-        meshMaterial);
-    scene->addHittables(*_rayMesh->getTriangles());
+    *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
+    mrRay::HittableList hittables;
+    if (!instancer) {
+        _rayMesh = std::make_shared<mrRay::Mesh>(
+            rawMeshInfo, _ToMat4(_transform), false, _material);
+        hittables.add(_rayMesh);
+    } else {
+        // Instanced meshes are kept in object space and shared by every
+        // instance, so each instance only costs its transform
+        _rayMesh = std::make_shared<mrRay::Mesh>(
+            rawMeshInfo, mrRay::Mat4::identity(), false, _material);
+        GfMatrix4d meshTransform = _transform.GetTranspose();
+        VtMatrix4dArray instanceTransforms
+            = static_cast<HdMrRayInstancer *>(instancer)
+                  ->ComputeInstanceTransforms(id);
+        for (GfMatrix4d const &instanceTransform: instanceTransforms) {
+            GfMatrix4d objToWorld
+                = (meshTransform * instanceTransform).GetTranspose();
+            hittables.add(std::make_shared<mrRay::Instance>(
+                _rayMesh, _ToMat4(objToWorld)));
+        }
+    }
+
+    // Replace what this prim added before rather than adding to it, so
+    // the scene only holds the prim's current geometry
+    if (_hittableHandle == mrRay::INVALID_HITTABLE_HANDLE) {
+        _hittableHandle = scene->addHittables(hittables);
+    } else {
+        scene->replaceHittables(_hittableHandle, hittables);
+    }
+}
+
+mrRay::Mat4
+HdMrRayMesh::_ToMat4(GfMatrix4d const &matrix)
+{
+    return mrRay::Mat4(
+        matrix[0][0],
+        matrix[0][1],
+        matrix[0][2],
+        matrix[0][3],
+        matrix[1][0],
+        matrix[1][1],
+        matrix[1][2],
+        matrix[1][3],
+        matrix[2][0],
+        matrix[2][1],
+        matrix[2][2],
+        matrix[2][3],
+        matrix[3][0],
+        matrix[3][1],
+        matrix[3][2],
+        matrix[3][3]);
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "pxr/pxr.h"
 
 #include <mrRay/geom/mesh.h>
+#include <mrRay/scene.h>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -33,11 +34,18 @@ protected:
     virtual HdDirtyBits _PropagateDirtyBits(HdDirtyBits bits) const override;
 
 private:
+    /// Converts a matrix that transforms column vectors to an mrRay matrix
+    static mrRay::Mat4 _ToMat4(GfMatrix4d const &matrix);
+
     HdMeshTopology _topology;
     GfMatrix4d _transform;
     VtVec3fArray _points;
 
     std::shared_ptr<mrRay::Mesh> _rayMesh;
+    // Resolved from displayColor, and only updated when that is dirty
+    std::shared_ptr<mrRay::Material> _material;
+    // The mesh, or its instances, in the scene
+    mrRay::HittableHandle _hittableHandle;
 
     HdMrRayMesh(const HdMrRayMesh &) = delete;
     HdMrRayMesh &operator=(const HdMrRayMesh &) = delete;
@@ -1,6 +1,7 @@
 #include "renderDelegate.h"
 
 #include "config.h"
+#include "instancer.h"
 #include "mesh.h"
 #include "renderPass.h"
 
@@ -47,7 +48,7 @@ HdMrRayRenderDelegate::HdMrRayRenderDelegate(
 void
 HdMrRayRenderDelegate::Initialize()
 {
-    _settingDescriptors.resize(3);
+    _settingDescriptors.resize(4);
     _settingDescriptors[0]
         = {"Samples Per Pixel",
            HdRenderSettingsTokens->convergedSamplesPerPixel,
@@ -60,6 +61,10 @@ HdMrRayRenderDelegate::Initialize()
         = {"Render Threads",
            HdRenderSettingsTokens->threadLimit,
            VtValue(int(HdMrRayConfig::GetInstance().threads))};
+    _settingDescriptors[3]
+        = {"Samples Per Pass",
+           HdMrRayRenderSettingsTokens->samplesPerPass,
+           VtValue(int(HdMrRayConfig::GetInstance().samplesPerPass))};
     _PopulateDefaultSettings(_settingDescriptors);
 
     _renderParam = std::make_shared<HdMrRayRenderParam>(
@@ -110,14 +115,13 @@ HdInstancer *
 HdMrRayRenderDelegate::CreateInstancer(
     HdSceneDelegate *delegate, const SdfPath &id)
 {
-    TF_CODING_ERROR("Creating instancer not supported");
-    return nullptr;
+    return new HdMrRayInstancer(delegate, id);
 }
 
 void
 HdMrRayRenderDelegate::DestroyInstancer(HdInstancer *instancer)
 {
-    TF_CODING_ERROR("Destroy instancer not supported");
+    delete instancer;
 }
 
 HdRprim *
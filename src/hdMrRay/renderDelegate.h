@@ -12,7 +12,7 @@
 
 PXR_NAMESPACE_OPEN_SCOPE
 
-#define HDMRRAY_RENDER_SETTINGS_TOKENS (tileSize)
+#define HDMRRAY_RENDER_SETTINGS_TOKENS (tileSize)(samplesPerPass)
 
 TF_DECLARE_PUBLIC_TOKENS(
     HdMrRayRenderSettingsTokens, HDMRRAY_RENDER_SETTINGS_TOKENS);
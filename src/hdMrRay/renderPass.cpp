@@ -42,6 +42,10 @@ HdMrRayRenderPass::_Execute(
             (unsigned int)renderDelegate->GetRenderSetting<int>(
                 HdRenderSettingsTokens->convergedSamplesPerPixel,
                 (int)HdMrRayConfig::GetInstance().samplesPerPixel));
+        _renderer->SetSamplesPerPass(
+            (unsigned int)renderDelegate->GetRenderSetting<int>(
+                HdMrRayRenderSettingsTokens->samplesPerPass,
+                (int)HdMrRayConfig::GetInstance().samplesPerPass));
         _renderer->SetTileSize(
             (unsigned int)renderDelegate->GetRenderSetting<int>(
                 HdMrRayRenderSettingsTokens->tileSize,
@@ -62,20 +62,48 @@ HdMrRayRenderer::Render(HdRenderThread *renderThread)
     _scene.setSkyboxTexture(std::make_shared<mrRay::SolidColour>(
         clearValue[0], clearValue[1], clearValue[2]));
 
+    // Tiles are streamed into the render buffers as soon as they finish,
+    // and short passes get a full, if noisy, image on screen quickly
     mrRay::RenderSettings renderSettings(
         width, height, _samplesPerPixel, _renderThreads, _tileSize);
+    renderSettings.samplesPerPass = _samplesPerPass;
     _engine.init(renderSettings);
+    _engine.registerTileFinishedCallback(
+        [this](const mrRay::Tile &tile, const mrRay::Film &film) {
+            _WriteTile(tile, film);
+        });
+    // Hydra asks for the render to stop whenever the camera or the scene
+    // changes, so in-flight renders are cancelled rather than waited on
+    _engine.registerPollCallback([this, renderThread]() {
+        if (renderThread->IsStopRequested()) {
+            _engine.stop();
+        } else if (renderThread->IsPauseRequested()) {
+            _engine.pause();
+        } else if (_engine.isPaused()) {
+            _engine.resume();
+        }
+    });
     _engine.execute(renderSettings, &_scene);
+    if (renderThread->IsStopRequested()) return;
 
-    mrRay::Colour *colours = _engine.getFilm()->getData();
+    for (auto const &aov: _aovBindings) {
+        HdMrRayRenderBuffer *rb
+            = static_cast<HdMrRayRenderBuffer *>(aov.renderBuffer);
+        rb->SetConverged(true);
+    }
+}
+
+void
+HdMrRayRenderer::_WriteTile(const mrRay::Tile &tile, const mrRay::Film &film)
+{
     for (auto const &aov: _aovBindings) {
         HdMrRayRenderBuffer *rb
             = static_cast<HdMrRayRenderBuffer *>(aov.renderBuffer);
         auto *target = (float *)rb->Map();
-        for (size_t y = 0; y < height; y++) {
-            for (size_t x = 0; x < width; x++) {
-                size_t index = y * width + x;
-                mrRay::Colour colour = colours[index];
+        for (size_t y = tile.top; y < tile.top + tile.height; y++) {
+            for (size_t x = tile.left; x < tile.left + tile.width; x++) {
+                size_t index = y * film.width + x;
+                mrRay::Colour colour = film.getColour(x, y);
                 target[index * 4] = remapColor(colour[0]);
                 target[index * 4 + 1] = remapColor(colour[1]);
                 target[index * 4 + 2] = remapColor(colour[2]);
@@ -83,7 +111,6 @@ HdMrRayRenderer::Render(HdRenderThread *renderThread)
             }
         }
         rb->Unmap();
-        rb->SetConverged(true);
     }
 }
 
@@ -34,6 +34,8 @@ public:
 
     void SetSamplesPerPixel(unsigned int spp) { _samplesPerPixel = spp; }
 
+    void SetSamplesPerPass(unsigned int spp) { _samplesPerPass = spp; }
+
     void SetTileSize(unsigned int tileSize) { _tileSize = tileSize; }
 
     void SetRenderThreads(unsigned int threads) { _renderThreads = threads; }
@@ -41,6 +43,9 @@ public:
     void Render(HdRenderThread *renderThread);
 
 private:
+    /// Copies the film's pixels in the tile to the AOV render buffers
+    void _WriteTile(const mrRay::Tile &tile, const mrRay::Film &film);
+
     HdRenderPassAovBindingVector _aovBindings;
 
     GfRect2i _dataWindow;
@@ -49,6 +54,7 @@ private:
     mrRay::Scene _scene;
 
     unsigned int _samplesPerPixel;
+    unsigned int _samplesPerPass;
     unsigned int _tileSize;
     unsigned int _renderThreads;
 };
@@ -33,10 +33,48 @@ public:
         return true;
     }
 
+    /// Returns the centre point of the box
+    Point3 centroid() const { return 0.5 * (min + max); }
+
+    /// Returns the surface area of the box
+    double surfaceArea() const
+    {
+        Vec3 d = max - min;
+        return 2 * (d.x() * d.y() + d.x() * d.z() + d.y() * d.z());
+    }
+
+    /// Returns the index of the axis with the largest extent
+    int maximumExtent() const
+    {
+        Vec3 d = max - min;
+        if (d.x() > d.y() && d.x() > d.z()) return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    /// Returns the position of p relative to the box corners, where min
+    /// maps to 0 and max maps to 1 along each axis
+    Vec3 offset(const Point3 &p) const
+    {
+        Vec3 o = p - min;
+        for (int a = 0; a < 3; a++) {
+            if (max[a] > min[a]) o[a] /= max[a] - min[a];
+        }
+        return o;
+    }
+
+    /// Returns a box that contains nothing, ready to be grown
+    static AABB empty()
+    {
+        return AABB(
+            Point3(infinity, infinity, infinity),
+            Point3(-infinity, -infinity, -infinity));
+    }
+
     Point3 min, max;
 };
 
 AABB surrounding_box(AABB box0, AABB box1);
+AABB surrounding_box(AABB box, const Point3 &p);
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
 
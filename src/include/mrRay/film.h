@@ -7,13 +7,14 @@
 
 #include "mrRay/namespace.h"
 #include "mrRay/rtutils.h"
+#include "mrRay/sampler.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+/// A rectangular region of the film
 struct Tile
 {
-    const unsigned int top, left, width, height;
-    Colour *colours;
+    unsigned int top, left, width, height;
 
     Tile(
         unsigned int top, unsigned int left, unsigned int width,
@@ -23,43 +24,29 @@ struct Tile
         , width(width)
         , height(height)
     {
-        colours = new Colour[width * height];
     }
-
-    ~Tile() { delete[] colours; }
 };
 
-class TilesQueue
+/// Samples taken for the pixels of a tile. Renders write the sum of the
+/// samples they took for each pixel into colours, along with the sum of the
+/// squared luminance of those samples and how many samples were taken.
+/// Each worker owns one and reuses it for every tile it renders.
+struct TileBuffer
 {
-public:
-    TilesQueue()
-        : currentIndex(0)
-    {
-    }
-
-    void addTile(std::shared_ptr<Tile> tile)
-    {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        tiles.push_back(tile);
-    }
-
-    Tile *getTile()
-    {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        if (currentIndex < tiles.size()) return tiles[currentIndex++].get();
-        return nullptr;
-    }
+    std::vector<Colour> colours;
+    std::vector<double> luminanceSquares;
+    std::vector<unsigned int> sampleCounts;
 
-    size_t remainingTiles()
+    /// Makes sure the buffer can hold the given tile. Never shrinks, so
+    /// a worker stops allocating once it has seen its largest tile.
+    void reserve(const Tile &tile)
     {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        return tiles.size();
+        size_t size = (size_t)tile.width * tile.height;
+        if (colours.size() >= size) return;
+        colours.resize(size);
+        luminanceSquares.resize(size);
+        sampleCounts.resize(size);
     }
-
-private:
-    std::vector<std::shared_ptr<Tile>> tiles;
-    int currentIndex;
-    std::mutex queueMutex;
 };
 
 struct Film
@@ -72,21 +59,97 @@ public:
         , height(height)
     {
         _colours = new Colour[width * height];
+        _sums = new Colour[width * height];
+        _luminanceSquares = new double[width * height];
+        _sampleCounts = new unsigned int[width * height];
+        _converged = new bool[width * height];
+        clear();
     }
 
-    ~Film() { delete[] _colours; }
+    ~Film()
+    {
+        delete[] _colours;
+        delete[] _sums;
+        delete[] _luminanceSquares;
+        delete[] _sampleCounts;
+        delete[] _converged;
+    }
+
+    // Add the sample sums in buffer to the tile's pixels. No lock is
+    // taken, so tiles added at the same time must not overlap. The tiles
+    // of a single pass never do.
+    void addTile(const Tile &tile, const TileBuffer &buffer);
+
+    // Reset all pixels back to black with no samples
+    void clear();
 
-    // Copy a tile of colours to this film
-    void writeTile(const Tile &tile);
+    // Marks every pixel in the tile as converged once they have all taken
+    // at least minSamples and the tile's standard error of luminance is
+    // below noiseThreshold relative to its mean luminance. Returns whether
+    // the tile has converged
+    bool updateConvergence(
+        const Tile &tile, double noiseThreshold, unsigned int minSamples);
+
+    bool isConverged(unsigned int x, unsigned int y) const
+    {
+        return _converged[y * width + x];
+    }
+
+    // Average of the samples taken so far for the given pixel
+    Colour getColour(unsigned int x, unsigned int y) const
+    {
+        return _colours[y * width + x];
+    }
+
+    // Amount of samples taken so far for the given pixel
+    unsigned int getSampleCount(unsigned int x, unsigned int y) const
+    {
+        return _sampleCounts[y * width + x];
+    }
+
+    // Mean amount of samples taken by the pixels in the tile
+    double averageSampleCount(const Tile &tile) const;
+
+    // Whether every pixel in the tile has converged
+    bool isConverged(const Tile &tile) const;
+
+    // Total amount of samples taken over all pixels
+    size_t totalSamples();
 
     // Write film to file
     void writeToFile(const std::string &path);
 
+    // Write the sample sums, sample counts and convergence of every pixel
+    // to a checkpoint file, along with the sampler they were taken with.
+    // The file is replaced in one step, so an interrupted write leaves the
+    // previous checkpoint intact. Returns whether it succeeded
+    bool writeCheckpoint(
+        const std::string &path, SamplerType samplerType, unsigned int frame);
+
+    // Replace the film's samples with those in a checkpoint file. Fails,
+    // leaving the film untouched, if the file can't be read or was written
+    // for a different film size or sampler, as more samples from another
+    // sampler would not continue the same sequences
+    bool readCheckpoint(
+        const std::string &path, SamplerType samplerType, unsigned int frame);
+
+    // Fewest samples taken by any pixel that has not converged. Returns
+    // the largest unsigned int if every pixel has converged
+    unsigned int minSampleCount() const;
+
     Colour *getData();
 
 private:
     std::mutex filmMutex;
+    // Average of all samples taken for each pixel
     Colour *_colours;
+    // Running sum of all samples taken for each pixel
+    Colour *_sums;
+    double *_luminanceSquares;
+    unsigned int *_sampleCounts;
+    // Pixels which need no more samples. Only written by whoever renders
+    // the tile containing the pixel, or between passes
+    bool *_converged;
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
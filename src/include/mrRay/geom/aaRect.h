@@ -28,12 +28,42 @@ public:
     virtual bool
     hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
     virtual bool
     bounding_box(double time0, double time1, AABB &output_box) const override
     {
         output_box = AABB(Point3(x0, y0, k - 0.0001), Point3(x1, y1, k + 0.0001));
         return true;
     }
+
+    virtual Material *getMaterial() const override { return mat.get(); }
+
+    // Given a random direction, what is the PDF of sampling this object
+    virtual double
+    pdf_value(const Point3 &o, const Vec3 &direction) const override
+    {
+        // Trace a ray to this hittable from the given location and direction
+        hit_record rec;
+        if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
+            return 0;
+        }
+
+        double area = (x1 - x0) * (y1 - y0);
+        double distanceSquared = rec.t * rec.t * direction.length_squared();
+        double cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+        return distanceSquared / (cosine * area);
+    }
+
+    // Generate a random direction to sample this PDF from
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override
+    {
+        Point3 randomPoint = Point3(
+            sampler.getDouble(x0, x1), sampler.getDouble(y0, y1), k);
+        return unit_vector(randomPoint - o);
+    }
 };
 
 class XZRect : public Hittable
@@ -57,6 +87,9 @@ public:
     virtual bool
     hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
     virtual bool
     bounding_box(double time0, double time1, AABB &output_box) const override
     {
@@ -64,13 +97,15 @@ public:
         return true;
     }
 
+    virtual Material *getMaterial() const override { return mat.get(); }
+
     // Given a random direction, what is the PDF of sampling this object
     virtual double
     pdf_value(const Point3 &o, const Vec3 &direction) const override
     {
         // Trace a ray to this hittable from the given location and direction
         hit_record rec;
-        if (!this->hit(Ray(o, direction), 0.001, infinity, rec)) {
+        if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
             return 0;
         }
 
@@ -82,10 +117,10 @@ public:
     }
 
     // Generate a random direction to sample this PDF from
-    virtual Vec3 random(const Vec3 &o) const override
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override
     {
-        Point3 randomPoint
-            = Point3(random_double(x0, x1), k, random_double(z0, z1));
+        Point3 randomPoint = Point3(
+            sampler.getDouble(x0, x1), k, sampler.getDouble(z0, z1));
         return unit_vector(randomPoint - o);
     }
 };
@@ -111,12 +146,42 @@ public:
     virtual bool
     hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
     virtual bool
     bounding_box(double time0, double time1, AABB &output_box) const override
     {
         output_box = AABB(Point3(k - 0.0001, y0, z0), Point3(k + 0.0001, y1, z1));
         return true;
     }
+
+    virtual Material *getMaterial() const override { return mat.get(); }
+
+    // Given a random direction, what is the PDF of sampling this object
+    virtual double
+    pdf_value(const Point3 &o, const Vec3 &direction) const override
+    {
+        // Trace a ray to this hittable from the given location and direction
+        hit_record rec;
+        if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
+            return 0;
+        }
+
+        double area = (y1 - y0) * (z1 - z0);
+        double distanceSquared = rec.t * rec.t * direction.length_squared();
+        double cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+        return distanceSquared / (cosine * area);
+    }
+
+    // Generate a random direction to sample this PDF from
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override
+    {
+        Point3 randomPoint = Point3(
+            k, sampler.getDouble(y0, y1), sampler.getDouble(z0, z1));
+        return unit_vector(randomPoint - o);
+    }
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
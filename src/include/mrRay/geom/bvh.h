@@ -0,0 +1,222 @@
+#ifndef MR_RAY_BVH_H
+#define MR_RAY_BVH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mrRay/geom/hittable.h"
+#include "mrRay/namespace.h"
+#include "mrRay/rtutils.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+/// Strategy used to partition primitives at each BVH node
+enum class BVHSplitMethod
+{
+    /// Split into two equally sized halves along the largest axis
+    EqualCounts,
+    /// Pick the split with the lowest surface area heuristic cost
+    SAH
+};
+
+/// Number of children per node used when traversing a BVH
+enum class BVHWidth
+{
+    /// Pick the widest layout the running CPU has SIMD support for
+    Auto,
+    Binary,
+    Four,
+    Eight
+};
+
+struct BVHSettings
+{
+    BVHSplitMethod splitMethod;
+    BVHWidth width;
+    /// Leaves are never made larger than this
+    unsigned int maxPrimsInLeaf;
+    /// Number of threads to build with. The built tree does not depend on
+    /// this, so it is ignored when comparing settings.
+    unsigned int buildThreads;
+    /// A refitted tree is rebuilt once its SAH cost grows past this multiple
+    /// of the cost it was built with. Also ignored when comparing settings.
+    double maxRefitCostRatio;
+
+    BVHSettings()
+        : splitMethod(BVHSplitMethod::SAH)
+        , width(BVHWidth::Auto)
+        , maxPrimsInLeaf(4)
+        , buildThreads(1)
+        , maxRefitCostRatio(2)
+    {
+    }
+
+    bool operator==(const BVHSettings &other) const
+    {
+        return splitMethod == other.splitMethod && width == other.width
+            && maxPrimsInLeaf == other.maxPrimsInLeaf;
+    }
+
+    bool operator!=(const BVHSettings &other) const { return !(*this == other); }
+};
+
+/// Node of the tree produced while building a BVH. Leaves reference a
+/// contiguous range of the BVH's ordered primitives.
+struct BVHBuildNode
+{
+    AABB bounds;
+    std::unique_ptr<BVHBuildNode> children[2];
+    int splitAxis;
+    size_t firstPrimOffset;
+    size_t nPrimitives;
+
+    bool isLeaf() const { return nPrimitives > 0; }
+};
+
+/// Compact BVH node used for traversal. Nodes are stored in depth-first
+/// order, so the first child of an interior node directly follows it.
+/// Bounds are rounded outwards to single precision.
+struct alignas(32) LinearBVHNode
+{
+    float boundsMin[3];
+    float boundsMax[3];
+    union
+    {
+        /// Leaf: index of the first primitive
+        uint32_t primitivesOffset;
+        /// Interior: index of the second child
+        uint32_t secondChildOffset;
+    };
+    /// Zero for interior nodes
+    uint16_t nPrimitives;
+    uint8_t axis;
+    uint8_t pad;
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+/// Node of a BVH collapsed to N children per node. Child bounds are stored
+/// as structure of arrays so all N can be slab tested with one SIMD
+/// instruction per plane. Nodes are stored in depth-first order.
+template <int N>
+struct alignas(64) WideBVHNode
+{
+    float boundsMin[3][N];
+    float boundsMax[3][N];
+    /// Index of the child node, or of the first primitive for leaves
+    uint32_t children[N];
+    /// Zero for interior children
+    uint16_t nPrimitives[N];
+    /// Number of valid children
+    uint8_t childCount;
+};
+
+/// \class BVHTree
+///
+/// Bounding volume hierarchy over primitives that are only known to it by
+/// index. Leaves reference contiguous ranges of leaf slots, and subclasses
+/// store their primitives in slot order so those ranges can be intersected
+/// directly.
+class BVHTree : public Hittable
+{
+public:
+    virtual bool
+    hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
+    virtual bool
+    bounding_box(double time0, double time1, AABB &output_box) const override;
+
+    /// Returns the SAH cost of the built binary tree, relative to the cost
+    /// of intersecting a single primitive
+    double sahCost() const { return _sahCost; }
+    /// Returns the number of nodes in the tree used for traversal
+    size_t nodeCount() const;
+    /// Returns the number of children per node used for traversal
+    int width() const { return _width; }
+    /// Returns the SAH cost of the nodes used for traversal relative to
+    /// their cost when the tree was built. This grows as refits stretch the
+    /// bounds of a tree that no longer suits its primitives.
+    double refitCostRatio() const;
+
+    /// Returns the widest node layout supported by the running CPU
+    static int maxSupportedWidth();
+
+    /// Intersects the primitives in leaf slots [first, first + count),
+    /// recording the closest hit in rec
+    virtual bool hitPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max, hit_record &rec) const = 0;
+    /// Returns whether any primitive in leaf slots [first, first + count)
+    /// is hit
+    virtual bool occludedPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max) const = 0;
+
+protected:
+    BVHTree();
+
+    /// Builds the tree over primitives with the given bounds. Returns the
+    /// index of the primitive to store in each leaf slot.
+    std::vector<size_t> build(
+        const std::vector<AABB> &primitiveBounds, const BVHSettings &settings);
+    /// Recomputes the node bounds bottom-up for primitives that have moved,
+    /// keeping the tree topology. slotBounds holds the bounds of the
+    /// primitive in each leaf slot.
+    void refitBounds(const std::vector<AABB> &slotBounds);
+
+private:
+    /// Writes the subtree at node into _nodes in depth-first order and
+    /// returns the index it was written to
+    uint32_t flatten(const BVHBuildNode *node);
+    /// Same as flatten, but pulls up grandchildren until each node has up
+    /// to N children
+    template <int N>
+    uint32_t collapse(
+        const BVHBuildNode *node, std::vector<WideBVHNode<N>> &nodes);
+    /// Returns the SAH cost of the nodes used for traversal, relative to
+    /// the total surface area of the given primitive bounds
+    double traversalCost(const std::vector<AABB> &primitiveBounds) const;
+
+    std::vector<LinearBVHNode> _nodes;
+    std::vector<WideBVHNode<4>> _nodes4;
+    std::vector<WideBVHNode<8>> _nodes8;
+    AABB _bounds;
+    bool _empty;
+    int _width;
+    bool _useAvx2;
+    double _sahCost;
+    double _builtTraversalCost;
+    double _traversalCost;
+};
+
+/// \class BVH
+///
+/// Bounding volume hierarchy over a set of hittables.
+class BVH : public BVHTree
+{
+public:
+    BVH(const std::vector<std::shared_ptr<Hittable>> &primitives,
+        const BVHSettings &settings = BVHSettings());
+
+    /// Refits the tree to the current bounds of its primitives
+    void refit();
+
+    virtual bool hitPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max, hit_record &rec) const override;
+
+    virtual bool occludedPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max) const override;
+
+private:
+    std::vector<std::shared_ptr<Hittable>> _primitives;
+};
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
+
+#endif // MR_RAY_BVH_H
@@ -27,6 +27,9 @@ public:
     virtual bool
     hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
     virtual bool
     bounding_box(double time0, double time1, AABB &output_box) const override
     {
@@ -35,6 +38,13 @@ public:
             Point3(center[0] + radius, center[1] + 0.0001, center[2] + radius));
         return true;
     }
+
+    virtual Material *getMaterial() const override { return mat.get(); }
+
+    virtual double
+    pdf_value(const Point3 &o, const Vec3 &direction) const override;
+
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override;
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
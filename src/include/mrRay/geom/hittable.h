@@ -4,10 +4,13 @@
 #include "mrRay/aabb.h"
 #include "mrRay/namespace.h"
 #include "mrRay/rtutils.h"
+#include "mrRay/sampler.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+class Hittable;
 class Material;
+struct BVHSettings;
 
 // FIXME: Find another place for this outside this header
 // A hit record contains information about a ray intersection with an object
@@ -16,6 +19,11 @@ struct hit_record
     Point3 p;
     Vec3 normal;
     Material *mat;
+    // The primitive that was hit
+    const Hittable *object;
+    // Index of the element of object that was hit, for objects such as
+    // meshes that are made up of several
+    size_t primitiveIndex;
     double t;
     double u;
     double v;
@@ -26,6 +34,15 @@ struct hit_record
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // Returns a ray leaving p in the given direction. The origin is pushed
+    // off the surface on the side the ray leaves from, so the ray can be
+    // traced from t = 0
+    inline Ray spawnRay(const Vec3 &direction) const
+    {
+        Vec3 n = dot(direction, normal) > 0 ? normal : -normal;
+        return Ray(offsetRayOrigin(p, n), direction);
+    }
 };
 
 class Hittable
@@ -37,6 +54,24 @@ public:
     virtual bool bounding_box(double time0, double time1, AABB &output_box) const
         = 0;
 
+    // Returns whether anything is hit between t_min and t_max. Unlike hit,
+    // this can stop at the first hit found and skips all shading setup
+    virtual bool occluded(const Ray &r, double t_min, double t_max) const
+    {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
+    // Builds the acceleration structure the object keeps over its own
+    // primitives, if it has one. The scene calls this on init, before it
+    // asks for the object's bounds
+    virtual void prepare(const BVHSettings &bvhSettings) {}
+
+    // Returns the material of this object, or nullptr for objects made up of
+    // other objects. Objects with a material should be able to be sampled
+    // with pdf_value and random, so that they can be used as lights
+    virtual Material *getMaterial() const { return nullptr; }
+
     // Given a random direction, what is the PDF of sampling this object
     virtual double pdf_value(const Point3 &o, const Vec3 &direction) const
     {
@@ -44,7 +79,10 @@ public:
     }
 
     // Generate a random direction to sample this PDF from
-    virtual Vec3 random(const Vec3 &o) const { return Vec3(1, 0, 0); }
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const
+    {
+        return Vec3(1, 0, 0);
+    }
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
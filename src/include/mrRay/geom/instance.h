@@ -0,0 +1,47 @@
+#ifndef MR_RAY_INSTANCE_H
+#define MR_RAY_INSTANCE_H
+
+#include "mrRay/geom/hittable.h"
+#include "mrRay/matrix.h"
+#include "mrRay/namespace.h"
+#include "mrRay/rtutils.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+/// \class Instance
+///
+/// Places a prototype in the scene with an affine transform. Rays are moved
+/// into the prototype's object space rather than the prototype being moved
+/// into the world, so any number of instances can share a single prototype
+/// and its bottom level BVH, such as a Mesh.
+///
+/// Instances are not sampled as lights. Emissive instances still light the
+/// scene when hit by a bounce.
+class Instance : public Hittable
+{
+public:
+    Instance(std::shared_ptr<Hittable> prototype, const Mat4 &objToWorld);
+
+    virtual bool
+    hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
+    virtual bool
+    bounding_box(double time0, double time1, AABB &output_box) const override;
+
+    virtual void prepare(const BVHSettings &bvhSettings) override;
+
+    /// Returns the shared object being instanced
+    Hittable *getPrototype() const { return _prototype.get(); }
+
+private:
+    std::shared_ptr<Hittable> _prototype;
+    Mat4 _objToWorld;
+    Mat4 _worldToObj;
+};
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
+
+#endif // MR_RAY_INSTANCE_H
@@ -1,13 +1,18 @@
 /**
- * A mesh is a collection of triangles. This class loads in a mesh from a .obj
- *file and sets up all the triangle instances needed such that the mesh can be
- *rendered.
+ * A mesh is a collection of triangles. Vertex positions are stored as
+ * separate x, y and z arrays of GeomReal, and the triangles only exist as
+ * entries in the index buffers. Those buffers are kept in the order of the
+ * mesh's BVH leaves, so leaves can be intersected without any per triangle
+ * objects. The BVH is built with the scene's settings when the scene the
+ * mesh is in is initialized.
  **/
 #ifndef MR_RAY_MESH_H
 #define MR_RAY_MESH_H
 
-#include "mrRay/geom/hittableList.h"
-#include "mrRay/geom/triangle.h"
+#include <mutex>
+#include <vector>
+
+#include "mrRay/geom/bvh.h"
 #include "mrRay/matrix.h"
 #include "mrRay/namespace.h"
 #include "mrRay/rtutils.h"
@@ -25,30 +30,94 @@ struct RawMeshInfo
     std::vector<int> uvIndices;
 };
 
-class Mesh
+class Mesh : public BVHTree
 {
 public:
     Mesh(
         const RawMeshInfo &meshInfo, const Mat4 &objToWorld,
         const bool &smoothShading, std::shared_ptr<Material> mat);
-    ~Mesh();
 
-    HittableList *getTriangles();
+    virtual bool
+    hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual Material *getMaterial() const override { return mat.get(); }
+
+    /// Builds the BVH, or rebuilds it if it was built with settings that
+    /// give a different tree
+    virtual void prepare(const BVHSettings &bvhSettings) override;
+
+    virtual double
+    pdf_value(const Point3 &o, const Vec3 &direction) const override;
+
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override;
+
+    virtual bool hitPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max, hit_record &rec) const override;
+
+    virtual bool occludedPrimitives(
+        uint32_t first, uint32_t count, const Ray &r, double t_min,
+        double t_max) const override;
+
+    /// Returns the number of triangles in the mesh
+    size_t getTriangleCount() const { return _faceCount; }
+
+    /// Moves the vertices of the mesh without changing its topology.
+    /// positions must have as many entries as the mesh was built with. The
+    /// BVH is refitted to the new positions, and only rebuilt when that
+    /// degrades it past BVHSettings::maxRefitCostRatio.
+    void setPositions(const std::vector<Vec3> &positions, const Mat4 &objToWorld);
 
     std::shared_ptr<Material> mat;
-    Vec3 *positions;
-    Vec3 *normals;
-    // FIXME: UVs should probably be Vec2 so we aren't wasting memory
-    Vec3 *uvs;
     bool smoothShading;
 
 private:
-    int *positionIndices;
-    int *normalIndices;
-    int *uvIndices;
-    size_t faceCount;
-    std::unique_ptr<HittableList> _triangles;
-    bool normalsDefined, uvsDefined;
+    /// Returns the position of the vertex with the given index
+    Vec3 getPosition(int index) const
+    {
+        return Vec3(_positionsX[index], _positionsY[index], _positionsZ[index]);
+    }
+    /// Returns the normal with the given index
+    Vec3 getNormal(int index) const
+    {
+        const GeomReal *normal = &_normals[index * 3];
+        return Vec3(normal[0], normal[1], normal[2]);
+    }
+    /// Möller–Trumbore intersection with the given triangle. On a hit, t
+    /// and the barycentric weights of the second and third vertex are
+    /// written to t, b1 and b2
+    bool intersectTriangle(
+        size_t triangle, const Ray &r, double t_min, double t_max, double &t,
+        double &b1, double &b2) const;
+    /// Returns the unnormalized geometric normal of the given triangle
+    Vec3 getFaceNormal(size_t triangle) const;
+    /// Returns the bounds of the given triangle
+    AABB getTriangleBounds(size_t triangle) const;
+    /// Builds the BVH over the current positions and reorders the index
+    /// buffers to match its leaves
+    void buildTree();
+    /// Builds the distribution used to pick triangles by area. This is only
+    /// needed when the mesh is sampled as a light, so it is built on first
+    /// use.
+    void buildAreaDistribution() const;
+
+    std::vector<GeomReal> _positionsX;
+    std::vector<GeomReal> _positionsY;
+    std::vector<GeomReal> _positionsZ;
+    // Three components per normal and two per uv
+    std::vector<GeomReal> _normals;
+    std::vector<GeomReal> _uvs;
+    std::vector<int> _positionIndices;
+    std::vector<int> _normalIndices;
+    std::vector<int> _uvIndices;
+    size_t _faceCount;
+    bool _normalsDefined, _uvsDefined;
+    // Settings of the last prepare, also used by rebuilds in setPositions
+    BVHSettings _bvhSettings;
+    bool _treeBuilt;
+
+    mutable std::once_flag _areaDistributionBuilt;
+    mutable std::vector<double> _areaCdf;
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
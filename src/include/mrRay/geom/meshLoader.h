@@ -1,9 +1,7 @@
 #ifndef MR_RAY_OBJLOADER_H
 #define MR_RAY_OBJLOADER_H
 
-#include "mrRay/geom/hittableList.h"
 #include "mrRay/geom/mesh.h"
-#include "mrRay/geom/triangle.h"
 #include "mrRay/namespace.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
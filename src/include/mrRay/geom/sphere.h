@@ -24,9 +24,19 @@ public:
     virtual bool
     hit(const Ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool
+    occluded(const Ray &r, double t_min, double t_max) const override;
+
     virtual bool
     bounding_box(double time0, double time1, AABB &output_box) const override;
 
+    virtual Material *getMaterial() const override { return mat.get(); }
+
+    virtual double
+    pdf_value(const Point3 &o, const Vec3 &direction) const override;
+
+    virtual Vec3 random(const Vec3 &o, Sampler &sampler) const override;
+
     static void get_sphere_uv(const Vec3 &p, double &u, double &v);
 };
 
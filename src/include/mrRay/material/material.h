@@ -31,9 +31,11 @@ schlick(double cosine, double ref_idx)
 class Material
 {
 public:
+    // Random numbers must come from the given sampler, which belongs to the
+    // calling render thread
     virtual bool scatter(
         const Ray &r_in, const hit_record &rec, scatter_record &srec,
-        MemoryArena &arena) const
+        MemoryArena &arena, Sampler &sampler) const
     {
         return false;
     }
@@ -61,7 +63,7 @@ public:
 
     virtual bool scatter(
         const Ray &r_in, const hit_record &rec, scatter_record &srec,
-        MemoryArena &arena) const override
+        MemoryArena &arena, Sampler &sampler) const override
     {
         srec.attenuation = Colour(1, 1, 1);
         srec.isSpecular = true;
@@ -77,21 +79,21 @@ public:
         double sin_theta = sqrt(1 - cos_theta * cos_theta);
         if (etai_over_etat * sin_theta > 1) {
             Vec3 reflected = reflect(unit_direction, rec.normal);
-            srec.specularRay = Ray(rec.p, reflected);
+            srec.specularRay = rec.spawnRay(reflected);
             return true;
         }
 
         // Use schlick approximation to get a reflected ray
         double reflect_prob = schlick(cos_theta, ref_idx);
-        if (random_double() < reflect_prob) {
+        if (sampler.getDouble() < reflect_prob) {
             Vec3 reflected = reflect(unit_direction, rec.normal);
-            srec.specularRay = Ray(rec.p, reflected);
+            srec.specularRay = rec.spawnRay(reflected);
             return true;
         }
 
         // If not reflected then refract
         Vec3 refracted = refract(unit_direction, rec.normal, etai_over_etat);
-        srec.specularRay = Ray(rec.p, refracted);
+        srec.specularRay = rec.spawnRay(refracted);
         return true;
     }
 };
@@ -107,7 +109,7 @@ public:
 
     virtual bool scatter(
         const Ray &r_in, const hit_record &rec, scatter_record &srec,
-        MemoryArena &arena) const override
+        MemoryArena &arena, Sampler &sampler) const override
     {
         return false;
     }
@@ -134,7 +136,7 @@ public:
 
     virtual bool scatter(
         const Ray &r_in, const hit_record &rec, scatter_record &srec,
-        MemoryArena &arena) const override
+        MemoryArena &arena, Sampler &sampler) const override
     {
         srec.isSpecular = false;
         srec.attenuation = albedo->value(rec.u, rec.v, rec);
@@ -165,24 +167,24 @@ public:
     // This is a mixture between diffuse and specular
     virtual bool scatter(
         const Ray &r_in, const hit_record &rec, scatter_record &srec,
-        MemoryArena &arena) const override
+        MemoryArena &arena, Sampler &sampler) const override
     {
         srec.attenuation = albedo;
 
         // We gonna split between diffuse and specular
-        double prob = random_double();
+        double prob = sampler.getDouble();
         if (prob > fuzz) {
             // Specular
             srec.isSpecular = true;
             Vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-            srec.specularRay = Ray(rec.p, reflected);
+            srec.specularRay = rec.spawnRay(reflected);
         } else {
             // Diffuse
             srec.isSpecular = false;
             srec.PDF_ptr = ARENA_ALLOC(arena, CosinePDF)(rec.normal);
         }
 
-        // scattered = Ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+        // scattered = rec.spawnRay(reflected + fuzz * random_in_unit_sphere());
         return true;
     }
 
@@ -2,9 +2,12 @@
 #define MR_RAY_MATRIX_H
 
 #include "mrRay/namespace.h"
+#include "mrRay/rtutils.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+/// Row major 4x4 matrix. Points and vectors are treated as columns, so the
+/// translation lives in the last column.
 class Mat4
 {
 public:
@@ -33,6 +36,45 @@ public:
 
     double operator[](int index) const { return _data[index]; }
 
+    Mat4 operator*(const Mat4 &other) const;
+
+    /// Returns the inverse of the matrix. Singular matrices return the
+    /// identity.
+    Mat4 inverse() const;
+
+    /// Transforms a point, including the translation
+    Point3 transformPoint(const Point3 &p) const
+    {
+        return Point3(
+            _data[0] * p[0] + _data[1] * p[1] + _data[2] * p[2] + _data[3],
+            _data[4] * p[0] + _data[5] * p[1] + _data[6] * p[2] + _data[7],
+            _data[8] * p[0] + _data[9] * p[1] + _data[10] * p[2] + _data[11]);
+    }
+
+    /// Transforms a direction, ignoring the translation
+    Vec3 transformVector(const Vec3 &v) const
+    {
+        return Vec3(
+            _data[0] * v[0] + _data[1] * v[1] + _data[2] * v[2],
+            _data[4] * v[0] + _data[5] * v[1] + _data[6] * v[2],
+            _data[8] * v[0] + _data[9] * v[1] + _data[10] * v[2]);
+    }
+
+    /// Transforms a normal by the transpose of this matrix. Call it on the
+    /// inverse of the matrix the surface was transformed by.
+    Vec3 transformNormal(const Vec3 &n) const
+    {
+        return Vec3(
+            _data[0] * n[0] + _data[4] * n[1] + _data[8] * n[2],
+            _data[1] * n[0] + _data[5] * n[1] + _data[9] * n[2],
+            _data[2] * n[0] + _data[6] * n[1] + _data[10] * n[2]);
+    }
+
+    static Mat4 identity()
+    {
+        return Mat4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+    }
+
 private:
     double _data[16];
 };
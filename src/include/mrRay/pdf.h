@@ -73,7 +73,7 @@ public:
 
     virtual Vec3 generate(Sampler &sampler) const override
     {
-        return ptr->random(o);
+        return ptr->random(o, sampler);
     }
 };
 
@@ -1,11 +1,21 @@
 #ifndef MR_RAY_RAY_H
 #define MR_RAY_RAY_H
 
+#include <cstdint>
+#include <cstring>
+
 #include "mrRay/namespace.h"
 #include "mrRay/vec3.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+// Offset applied to ray origins, in float ulps per unit of normal
+const float RAY_ORIGIN_OFFSET_ULPS = 256.0f;
+// Below this magnitude float spacing shrinks faster than the error of a
+// hit point does, so a fixed offset is used instead
+const float RAY_ORIGIN_OFFSET_THRESHOLD = 1.0f / 32.0f;
+const float RAY_ORIGIN_OFFSET_SCALE = 1.0f / 65536.0f;
+
 class Ray
 {
 public:
@@ -25,6 +35,30 @@ public:
     Point3 at(double t) const { return orig + t * dir; }
 };
 
+/// Returns p moved off the surface with normal n, towards the side n points
+/// to. Each coordinate moves by a number of float ulps, so the offset scales
+/// with the rounding error of single precision geometry and rays leaving p
+/// can be traced from t = 0 without hitting the surface again.
+inline Point3
+offsetRayOrigin(const Point3 &p, const Vec3 &n)
+{
+    Point3 offset;
+    for (int a = 0; a < 3; a++) {
+        float value = (float)p[a];
+        if (fabs(value) < RAY_ORIGIN_OFFSET_THRESHOLD) {
+            offset[a] = p[a] + RAY_ORIGIN_OFFSET_SCALE * n[a];
+            continue;
+        }
+        int32_t bits;
+        std::memcpy(&bits, &value, sizeof(float));
+        int32_t ulps = (int32_t)(RAY_ORIGIN_OFFSET_ULPS * n[a]);
+        bits += value < 0 ? -ulps : ulps;
+        std::memcpy(&value, &bits, sizeof(float));
+        offset[a] = value;
+    }
+    return offset;
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
 
 #endif // MR_RAY_RAY_H
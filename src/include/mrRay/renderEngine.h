@@ -1,13 +1,21 @@
 #ifndef MR_RAY_RENDERENGINE_H
 #define MR_RAY_RENDERENGINE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "mrRay/film.h"
 #include "mrRay/memory.h"
 #include "mrRay/namespace.h"
 #include "mrRay/sampler.h"
 #include "mrRay/scene.h"
+#include "mrRay/threadPool.h"
+#include "mrRay/tileScheduler.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
@@ -17,6 +25,42 @@ struct RenderSettings {
     unsigned int samplesPerPixel;
     unsigned int threads;
     unsigned int tileSize;
+    /// Tiles stolen by an idle thread are split in half until they are
+    /// smaller than this. 0 disables splitting.
+    unsigned int minSplitTileSize;
+    /// Samples taken per pixel in each progressive pass over the frame.
+    /// 0 takes all samplesPerPixel in a single pass.
+    unsigned int samplesPerPass;
+    /// Tiles stop taking samples once the standard error of their pixels'
+    /// luminance falls below this fraction of their mean luminance.
+    /// samplesPerPixel is still the upper bound. 0 disables adaptive
+    /// sampling.
+    double noiseThreshold;
+    /// Samples every pixel takes before it is tested for convergence
+    unsigned int minSamplesPerPixel;
+    /// Wall clock seconds the render may take, including the scene init.
+    /// Passes are sized to use up as much of it as possible, and render
+    /// threads stop taking tiles once it has run out. samplesPerPixel is
+    /// still the upper bound. 0 disables the budget.
+    double timeBudget;
+    /// Most bounces a path can take before it is terminated
+    unsigned int maxDepth;
+    /// Seeds the random numbers used by every pixel sample. Changing it per
+    /// frame stops neighbouring frames from sharing the same noise.
+    unsigned int frame;
+    SamplerType samplerType;
+    /// Binds each render thread to its own CPU, where supported
+    bool pinThreads;
+    /// File the film is checkpointed to between passes, and once more when
+    /// the render ends. Empty disables checkpoints.
+    std::string checkpointPath;
+    /// Least number of seconds between checkpoints
+    double checkpointInterval;
+    /// Continues from the samples in checkpointPath, if it holds a
+    /// checkpoint of the same film size and sampler. samplesPerPixel is
+    /// then the total to reach, so a finished render can be extended by
+    /// resuming it with more samples.
+    bool resume;
 
     RenderSettings(
         unsigned int w, unsigned int h, unsigned int spp, unsigned int threads,
@@ -26,6 +70,17 @@ struct RenderSettings {
         , samplesPerPixel(spp)
         , threads(threads)
         , tileSize(tileSize)
+        , minSplitTileSize(8)
+        , samplesPerPass(0)
+        , noiseThreshold(0)
+        , minSamplesPerPixel(16)
+        , timeBudget(0)
+        , maxDepth(12)
+        , frame(0)
+        , samplerType(SamplerType::Independent)
+        , pinThreads(false)
+        , checkpointInterval(60)
+        , resume(false)
     {
     }
 
@@ -35,47 +90,138 @@ struct RenderSettings {
         , samplesPerPixel(other.samplesPerPixel)
         , threads(other.threads)
         , tileSize(other.tileSize)
+        , minSplitTileSize(other.minSplitTileSize)
+        , samplesPerPass(other.samplesPerPass)
+        , noiseThreshold(other.noiseThreshold)
+        , minSamplesPerPixel(other.minSamplesPerPixel)
+        , timeBudget(other.timeBudget)
+        , maxDepth(other.maxDepth)
+        , frame(other.frame)
+        , samplerType(other.samplerType)
+        , pinThreads(other.pinThreads)
+        , checkpointPath(other.checkpointPath)
+        , checkpointInterval(other.checkpointInterval)
+        , resume(other.resume)
     {
     }
 
     double aspectRatio() const { return imageWidth / (double)imageHeight; }
 };
 
+/// State kept by each render thread. Blocks are owned by the RenderEngine
+/// and reused by every render, so their arenas and buffers stay allocated.
 struct ExecutionBlock {
     const unsigned int blockID;
-    const RenderSettings renderSettings;
-    Sampler sampler;
+    RenderSettings renderSettings;
+    std::unique_ptr<Sampler> sampler;
     MemoryArena arena;
+    // Where the tile being rendered is accumulated before it is added to
+    // the film
+    TileBuffer tileBuffer;
 
     ExecutionBlock(unsigned int blockID, const RenderSettings &renderSettings)
         : blockID(blockID)
         , renderSettings(renderSettings)
         , arena()
-        , sampler(blockID) {};
-
-    void execute(Scene *scene, const Tile &tile);
+        , sampler(Sampler::create(
+              renderSettings.samplerType, renderSettings.frame)) {};
+
+    // Takes on the settings of a new render. The sampler is only recreated
+    // if the settings it depends on have changed
+    void configure(const RenderSettings &settings);
+
+    // Sums the given amount of samples for each pixel of the tile into
+    // tileBuffer, skipping pixels that have already converged in the film.
+    // Pixels never go past renderSettings.samplesPerPixel in total.
+    // Returns false if stopRequested was set before the tile was finished
+    bool execute(
+        Scene *scene, const Tile &tile, unsigned int samples, const Film &film,
+        const std::atomic<bool> &stopRequested);
 };
 
 class RenderEngine
 {
 public:
+    /// Called after each pass with the total samples per pixel taken so far
+    using PassFinishedCallback = std::function<void(unsigned int samples)>;
+    /// Called from the render threads as soon as a tile has been added to
+    /// the film. Tiles passed to it at the same time never overlap.
+    using TileFinishedCallback
+        = std::function<void(const Tile &tile, const Film &film)>;
+    /// Called regularly by the thread running execute while the render
+    /// threads are busy. Callers that are blocked in execute can use it to
+    /// stop, pause or resume the render.
+    using PollCallback = std::function<void()>;
+
     RenderEngine();
     ~RenderEngine();
 
     // Sets up film/tile buffers. Required before running execute()
     void init(const RenderSettings &renderSettings);
-    // Runs the execution
+    // Runs the execution. Stops requested before the call don't carry
+    // over to it
     void execute(const RenderSettings &renderSettings, Scene *scene);
+    // Stops the running execution, including while the scene is being
+    // initialized. Render threads give up between samples, and tiles they
+    // were part way through are discarded. A paused render is unpaused.
+    // Safe to call from any thread
+    void stop();
+    // Holds the render threads once they finish their current tile, until
+    // resume is called. Safe to call from any thread
+    void pause();
+    // Lets paused render threads carry on. Safe to call from any thread
+    void resume();
+    bool isPaused() const { return _paused; }
+
+    void registerPassFinishedCallback(PassFinishedCallback callback)
+    {
+        _passFinishedCallback = callback;
+    }
+    void registerTileFinishedCallback(TileFinishedCallback callback)
+    {
+        _tileFinishedCallback = callback;
+    }
+    void registerPollCallback(PollCallback callback)
+    {
+        _pollCallback = callback;
+    }
     // TODO:
     //    void registerRenderFinishedCallback();
-    //    void registerTileFinishedCallback();
 
     std::shared_ptr<Film> getFilm() { return _film; }
+    /// Returns the tiles the film is divided into. Together with
+    /// Film::averageSampleCount, this reports how many samples each region
+    /// of the image reached
+    const std::vector<Tile> &getTiles() const { return _tiles; }
 
 private:
+    // Renders tiles from the scheduler on the calling thread until there
+    // are none left or the render is stopped
+    void executeBlock(
+        ExecutionBlock *block, Scene *scene, TileScheduler *scheduler,
+        unsigned int samples);
+    // Blocks while the render is paused. Returns false if it was stopped
+    bool waitWhilePaused();
+    // Makes sure the thread pool and execution blocks match the settings,
+    // keeping the existing ones where possible
+    void prepareThreads(const RenderSettings &renderSettings);
+
     std::shared_ptr<Film> _film;
-    std::shared_ptr<TilesQueue> _tilesQueue;
+    std::vector<Tile> _tiles;
+    std::unique_ptr<ThreadPool> _threadPool;
+    std::vector<std::unique_ptr<ExecutionBlock>> _blocks;
     bool _hasInitialized;
+    std::atomic<bool> _stopRequested;
+    // Render threads stop taking tiles after the deadline, if there is one
+    std::chrono::steady_clock::time_point _deadline;
+    bool _hasDeadline;
+    std::atomic<bool> _paused;
+    std::mutex _controlMutex;
+    // Signalled when the render is stopped or resumed
+    std::condition_variable _controlCondition;
+    PassFinishedCallback _passFinishedCallback;
+    TileFinishedCallback _tileFinishedCallback;
+    PollCallback _pollCallback;
 
     RenderEngine(const RenderEngine &) = delete;
     RenderEngine &operator=(const RenderEngine &) = delete;
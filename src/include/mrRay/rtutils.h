@@ -16,6 +16,16 @@ MR_RAY_NAMESPACE_OPEN_SCOPE
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
 
+// Types
+
+// Scalar type bulk geometry such as mesh vertices is stored in. Hit
+// points, rays and shading stay in double either way.
+#if defined(MR_RAY_DOUBLE_PRECISION_GEOMETRY)
+typedef double GeomReal;
+#else
+typedef float GeomReal;
+#endif
+
 // Utility Functions
 
 inline double
@@ -24,7 +34,8 @@ degrees_to_radians(double degrees)
     return degrees * pi / 180.0;
 }
 
-// FIXME: This function isn't thread-safe
+// FIXME: This function isn't thread-safe. Rendering code should use the
+//   render thread's Sampler instead
 inline double
 random_double()
 {
@@ -1,43 +1,168 @@
 #ifndef MR_RAY_SAMPLER_H
 #define MR_RAY_SAMPLER_H
 
-#include <random>
+#include <cstdint>
+#include <memory>
 
 #include "mrRay/namespace.h"
-#include "mrRay/vec3.h"
+#include "mrRay/rtutils.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+enum class SamplerType
+{
+    /// Independent uniform random numbers
+    Independent,
+    /// Owen scrambled Sobol points
+    Sobol
+};
+
+/// \class Sampler
+///
+/// Generates the numbers used to take pixel samples. Before each pixel
+/// sample the sampler is reset from the pixel, the sample index and the
+/// sampler's own seed, so the numbers a sample uses never depend on which
+/// thread renders it or in what order.
+///
+/// Each number drawn belongs to a dimension of the sample. Dimensions
+/// start at 0 for each pixel sample and advance by one per number drawn;
+/// setDimension jumps to a fixed dimension so that, for example, every
+/// bounce of a path can use its own dimensions however many numbers the
+/// previous bounce drew.
 class Sampler
 {
 public:
-    Sampler(int seed)
+    Sampler(uint64_t seed)
         : seed(seed)
-        , generator(std::mt19937(seed))
-        , dist(0.0, 1.0)
     {
     }
 
-    double getDouble() { return dist(generator); }
+    virtual ~Sampler() {}
+
+    /// Creates a sampler of the given type
+    static std::unique_ptr<Sampler> create(SamplerType type, uint64_t seed);
+
+    /// Resets the sampler for the given sample of the given pixel
+    virtual void
+    startPixelSample(unsigned int x, unsigned int y, unsigned int index)
+        = 0;
+
+    /// Sets the dimension the next number is drawn from
+    virtual void setDimension(unsigned int dimension) {}
+
+    /// Returns a number in [0, 1)
+    virtual double getDouble() = 0;
 
     double getDouble(double start, double end)
     {
         return (end - start) * getDouble() + start;
     }
 
+    /// Returns a point in the unit disk. Uses two dimensions
     Vec3 inUnitDisk()
     {
-        while (true) {
-            Vec3 p = Vec3(getDouble(-1.0, 1.0), getDouble(-1.0, 1.0), 0);
-            if (p.length_squared() >= 1) continue;
-            return p;
-        }
+        // Polar mapping rather than rejection, so exactly two numbers are
+        // drawn and their stratification carries over to the disk
+        double r = sqrt(getDouble());
+        double theta = 2 * pi * getDouble();
+        return Vec3(r * cos(theta), r * sin(theta), 0);
+    }
+
+protected:
+    // SplitMix64 finalizer, used to spread seeds over the state space
+    static uint64_t mix(uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t seed;
+};
+
+/// \class IndependentSampler
+///
+/// Draws independent uniform numbers from a PCG32 generator.
+class IndependentSampler : public Sampler
+{
+public:
+    IndependentSampler(uint64_t seed)
+        : Sampler(seed)
+    {
+        setSequence(seed, 0);
+    }
+
+    virtual void startPixelSample(
+        unsigned int x, unsigned int y, unsigned int index) override
+    {
+        setSequence(mix(mix(mix(seed) ^ x) ^ y) ^ index, mix(x + 1) ^ y);
     }
 
+    virtual double getDouble() override { return nextUint() * 0x1p-32; }
+
+private:
+    // PCG32 initialization, see pcg-random.org
+    void setSequence(uint64_t initState, uint64_t sequence)
+    {
+        state = 0;
+        inc = (sequence << 1u) | 1u;
+        nextUint();
+        state += initState;
+        nextUint();
+    }
+
+    uint32_t nextUint()
+    {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + inc;
+        uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+        uint32_t rot = (uint32_t)(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+    }
+
+    uint64_t state;
+    uint64_t inc;
+};
+
+/// \class SobolSampler
+///
+/// Draws points from the first two dimensions of the Sobol sequence. Each
+/// consecutive pair of dimensions is its own 2D Sobol sequence, decorrelated
+/// from the other pairs by Owen scrambling both the points and the order
+/// they are visited in with a seed per pixel and pair.
+class SobolSampler : public Sampler
+{
+public:
+    SobolSampler(uint64_t seed)
+        : Sampler(seed)
+        , pixelSeed(0)
+        , index(0)
+        , dimension(0)
+        , cachedPair(~0u)
+        , pairSeed(0)
+        , shuffledIndex(0)
+    {
+    }
+
+    virtual void startPixelSample(
+        unsigned int x, unsigned int y, unsigned int index) override;
+
+    virtual void setDimension(unsigned int dimension) override
+    {
+        this->dimension = dimension;
+    }
+
+    virtual double getDouble() override;
+
 private:
-    int seed;
-    std::mt19937 generator;
-    std::uniform_real_distribution<double> dist;
+    uint64_t pixelSeed;
+    uint32_t index;
+    unsigned int dimension;
+    // Both dimensions of a pair share a seed and shuffled index, so they
+    // are kept for the pair that was last drawn from
+    unsigned int cachedPair;
+    uint64_t pairSeed;
+    uint32_t shuffledIndex;
 };
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -1,27 +1,54 @@
 #ifndef MR_RAY_SCENE_H
 #define MR_RAY_SCENE_H
 
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
+#include <vector>
 
 #include "mrRay/camera.h"
+#include "mrRay/geom/bvh.h"
 #include "mrRay/geom/hittableList.h"
 #include "mrRay/material/texture.h"
 #include "mrRay/namespace.h"
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+/// Identifies a group of hittables that were added to a scene together, so
+/// they can later be replaced or removed
+typedef uint64_t HittableHandle;
+/// Handle that never refers to any hittables
+const HittableHandle INVALID_HITTABLE_HANDLE = 0;
+
 class Scene
 {
 public:
     Scene();
 
-    /// Initializes the scene, making it ready for rendering
-    void init();
+    /// Initializes the scene, making it ready for rendering. Each group of
+    /// hittables has its own acceleration structure, which is only rebuilt
+    /// if the group or the given settings have changed since the last
+    /// call, and only refitted if just its bounds have changed. Hittables
+    /// in rebuilt groups are prepared with the same settings first, which
+    /// builds the trees of meshes. The
+    /// structure over the groups is rebuilt whenever groups are added,
+    /// replaced or removed.
+    void init(const BVHSettings &bvhSettings = BVHSettings());
     /// Add the given hittable to the scene
-    void addHittable(const std::shared_ptr<Hittable> &hittable);
-    /// Add the given hittables to the scene
-    void addHittables(const HittableList &hittableList);
+    HittableHandle addHittable(const std::shared_ptr<Hittable> &hittable);
+    /// Add the given hittables to the scene as one group
+    HittableHandle addHittables(const HittableList &hittableList);
+    /// Replace the hittables in the group with the given ones
+    void
+    replaceHittables(HittableHandle handle, const HittableList &hittableList);
+    /// Remove the group of hittables from the scene
+    void removeHittables(HittableHandle handle);
+    /// Marks that hittables in the group have moved or deformed, so the
+    /// acceleration structures containing them are refitted on the next
+    /// init
+    void markBoundsDirty(HittableHandle handle);
     /// Set the camera to render from
     void setMainCam(const std::shared_ptr<Camera> &camera)
     {
@@ -38,13 +65,46 @@ public:
     };
     /// Returns the scene's skybox texture
     Texture *getSkyboxTexture() const { return _skyboxTexture.get(); }
+    /// Returns the emissive hittables in the scene, collected on init
+    const std::vector<Hittable *> &getLights() const { return _lights; }
+    /// Returns a light picked uniformly from the light list, or nullptr if
+    /// the scene has no lights
+    Hittable *sampleLight(Sampler &sampler) const;
+    /// Returns the PDF of sampling the given direction from o by picking
+    /// the given object with sampleLight. This is 0 for non-lights
+    double lightPdf(
+        const Hittable *object, const Point3 &o, const Vec3 &direction) const;
 
 private:
+    struct HittableGroup
+    {
+        std::vector<std::shared_ptr<Hittable>> hittables;
+        /// What the top level BVH holds for the group. This is the
+        /// hittable itself for groups of one, and a BVH over the group
+        /// otherwise.
+        std::shared_ptr<Hittable> root;
+        std::shared_ptr<BVH> bvh;
+        bool dirty = true;
+        bool boundsDirty = false;
+    };
+
+    /// Rebuilds the acceleration structure of a single group
+    void buildGroup(HittableGroup &group, const BVHSettings &bvhSettings);
+    /// Rebuilds the acceleration structure over the groups and the light
+    /// list
+    void rebuild(const BVHSettings &bvhSettings);
+
     std::shared_ptr<Camera> _mainCamera;
-    std::shared_ptr<Hittable> _world;
-    std::shared_ptr<HittableList> _rawHittables;
+    std::shared_ptr<BVH> _world;
+    // Ordered so that builds do not depend on hashing
+    std::map<HittableHandle, HittableGroup> _groups;
+    HittableHandle _nextHandle;
     std::shared_ptr<Texture> _skyboxTexture;
-    bool _hittableListDirty;
+    std::vector<Hittable *> _lights;
+    std::unordered_set<const Hittable *> _lightSet;
+    BVHSettings _bvhSettings;
+    bool _groupsDirty;
+    bool _boundsDirty;
     std::recursive_mutex _sceneMutex;
 
     Scene(const Scene &) = delete;
@@ -0,0 +1,66 @@
+#ifndef MR_RAY_THREADPOOL_H
+#define MR_RAY_THREADPOOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mrRay/namespace.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+/// \class ThreadPool
+///
+/// Fixed set of worker threads that live as long as the pool. Every job is
+/// run once on each worker, so anything a worker keeps per thread stays
+/// warm from one job to the next.
+class ThreadPool
+{
+public:
+    /// Called on each worker with the worker's index
+    using Job = std::function<void(unsigned int worker)>;
+
+    /// Pinned workers are each bound to their own CPU, where the platform
+    /// supports it
+    ThreadPool(unsigned int threadCount, bool pinThreads = false);
+    ~ThreadPool();
+
+    unsigned int size() const { return _threads.size(); }
+    bool pinned() const { return _pinThreads; }
+
+    /// Starts running the job on every worker. The previous job must have
+    /// been waited on first.
+    void dispatch(const Job &job);
+    /// Blocks until every worker has finished the dispatched job
+    void wait();
+    /// Blocks until every worker has finished the dispatched job or the
+    /// timeout has passed. Returns whether the job has finished
+    bool wait(std::chrono::milliseconds timeout);
+
+private:
+    void workerLoop(unsigned int worker);
+
+    std::vector<std::thread> _threads;
+    bool _pinThreads;
+    std::mutex _mutex;
+    // Signalled when a job is dispatched or the pool shuts down
+    std::condition_variable _jobCondition;
+    // Signalled when the last worker finishes a job
+    std::condition_variable _doneCondition;
+    Job _job;
+    // Incremented for every job, so workers can tell a new job apart from
+    // one they have already run
+    unsigned long _generation;
+    unsigned int _pendingWorkers;
+    bool _shutdown;
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+};
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
+
+#endif // MR_RAY_THREADPOOL_H
@@ -0,0 +1,65 @@
+#ifndef MR_RAY_TILESCHEDULER_H
+#define MR_RAY_TILESCHEDULER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mrRay/film.h"
+#include "mrRay/namespace.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+/// \class TileScheduler
+///
+/// Hands out tiles to a fixed set of workers. Every worker owns a queue of
+/// tiles and only touches the other queues once its own runs dry, at which
+/// point it steals from the back of another worker's queue. Stolen tiles
+/// can optionally be split in half, leaving the other half up for grabs,
+/// so that the expensive tiles left at the end of a render get shared out.
+class TileScheduler
+{
+public:
+    /// A minSplitSize of 0 disables tile splitting
+    TileScheduler(unsigned int workerCount, unsigned int minSplitSize = 0);
+
+    /// Replaces any outstanding work with the given tiles. Neighbouring
+    /// tiles are kept together on the same worker.
+    void schedule(const std::vector<Tile *> &tiles);
+    /// Returns the next tile for the given worker to render, or nullptr
+    /// once there is nothing left to render
+    Tile *getTile(unsigned int worker);
+
+private:
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Tile *> tiles;
+    };
+
+    Tile *steal(unsigned int worker);
+    /// Splits tile in half along its longest side. The first half is
+    /// returned and the second half is queued on the given worker.
+    Tile *split(Tile *tile, unsigned int worker);
+    /// Returns a tile from the pool of split tiles, set to the given region
+    Tile *acquireSplitTile(
+        unsigned int top, unsigned int left, unsigned int width,
+        unsigned int height);
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    unsigned int _minSplitSize;
+    // Tiles made by splitting. A deque never moves its elements, so tiles
+    // stay valid while more are added, and they are reused by later passes
+    // rather than reallocated.
+    std::deque<Tile> _splitTiles;
+    size_t _splitTilesUsed;
+    std::mutex _splitTilesMutex;
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+};
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
+
+#endif // MR_RAY_TILESCHEDULER_H
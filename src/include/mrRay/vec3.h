@@ -198,6 +198,13 @@ refract(const Vec3 &v, const Vec3 &n, double etai_over_etat)
     return r_out_parallel + r_out_perp;
 }
 
+// Relative luminance of a linear Rec. 709 colour
+inline double
+luminance(const Colour &c)
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
 
 #endif // MR_RAY_VEC3_H
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <thread>
 
@@ -77,6 +78,54 @@ main(int argc, char **argv)
         .scan<'u', unsigned int>()
         .help("Tile size")
         .default_value(64u);
+    program.add_argument("--splitsize")
+        .scan<'u', unsigned int>()
+        .help("Smallest size that tiles stolen by idle threads get split "
+              "down to. 0 disables splitting")
+        .default_value(8u);
+    program.add_argument("--passspp")
+        .scan<'u', unsigned int>()
+        .help("Samples per pixel taken in each progressive pass. 0 renders "
+              "all samples in one pass")
+        .default_value(0u);
+    program.add_argument("--noise")
+        .scan<'g', double>()
+        .help("Relative noise level at which pixels stop taking samples. "
+              "0 disables adaptive sampling")
+        .default_value(0.0);
+    program.add_argument("--minspp")
+        .scan<'u', unsigned int>()
+        .help("Samples per pixel taken before adaptive sampling kicks in")
+        .default_value(16u);
+    program.add_argument("--time")
+        .scan<'g', double>()
+        .help("Seconds the render may take. Samples are fitted to the time, "
+              "with --spp as the upper bound. 0 disables the time budget")
+        .default_value(0.0);
+    program.add_argument("--maxdepth")
+        .scan<'u', unsigned int>()
+        .help("Maximum number of bounces per path")
+        .default_value(12u);
+    program.add_argument("--frame")
+        .scan<'u', unsigned int>()
+        .help("Frame number, used to seed the random numbers")
+        .default_value(0u);
+    program.add_argument("--sampler")
+        .help("Sampler to use: independent or sobol")
+        .default_value(std::string("independent"));
+    program.add_argument("--checkpoint")
+        .help("File to checkpoint the render to, so it can be resumed. "
+              "Empty disables checkpoints")
+        .default_value(std::string(""));
+    program.add_argument("--checkpoint-interval")
+        .scan<'g', double>()
+        .help("Least number of seconds between checkpoints")
+        .default_value(60.0);
+    program.add_argument("--resume")
+        .help("Continue from the samples in the checkpoint file, up to --spp "
+              "in total")
+        .default_value(false)
+        .implicit_value(true);
     program.add_argument("out").help("Output path");
 
     try {
@@ -92,17 +141,61 @@ main(int argc, char **argv)
     const unsigned int spp = program.get<unsigned int>("--spp");
     const unsigned int threads = program.get<unsigned int>("--threads");
     const unsigned int tileSize = program.get<unsigned int>("--tilesize");
+    const unsigned int splitSize = program.get<unsigned int>("--splitsize");
+    const unsigned int passSpp = program.get<unsigned int>("--passspp");
+    const double noise = program.get<double>("--noise");
+    const unsigned int minSpp = program.get<unsigned int>("--minspp");
+    const double timeBudget = program.get<double>("--time");
+    const unsigned int maxDepth = program.get<unsigned int>("--maxdepth");
+    const unsigned int frame = program.get<unsigned int>("--frame");
+    const std::string sampler = program.get<std::string>("--sampler");
+    const std::string checkpoint = program.get<std::string>("--checkpoint");
+    const double checkpointInterval
+        = program.get<double>("--checkpoint-interval");
+    const bool resume = program.get<bool>("--resume");
     const std::string out = program.get<std::string>("out");
 
     RenderSettings renderSettings(width, height, spp, threads, tileSize);
+    renderSettings.minSplitTileSize = splitSize;
+    renderSettings.samplesPerPass = passSpp;
+    renderSettings.noiseThreshold = noise;
+    renderSettings.minSamplesPerPixel = minSpp;
+    renderSettings.timeBudget = timeBudget;
+    renderSettings.maxDepth = maxDepth;
+    renderSettings.frame = frame;
+    renderSettings.checkpointPath = checkpoint;
+    renderSettings.checkpointInterval = checkpointInterval;
+    renderSettings.resume = resume;
+    if (sampler == "sobol") {
+        renderSettings.samplerType = SamplerType::Sobol;
+    } else if (sampler != "independent") {
+        std::cerr << "Unknown sampler: " << sampler << std::endl;
+        std::cerr << program << std::endl;
+        return 1;
+    }
     auto cornell = cornellBox(renderSettings);
 
     RenderEngine engine;
     engine.init(renderSettings);
+    engine.registerPassFinishedCallback([spp](unsigned int samples) {
+        std::cout << "Finished pass: " << samples << "/" << spp << " spp"
+                  << std::endl;
+    });
     {
         Timer timer("execute");
         engine.execute(renderSettings, cornell.get());
     }
+    std::cout << "Average samples per pixel: "
+              << engine.getFilm()->totalSamples() / (double)(width * height)
+              << std::endl;
+    double minTileSpp = spp, maxTileSpp = 0;
+    for (const Tile &tile: engine.getTiles()) {
+        double tileSpp = engine.getFilm()->averageSampleCount(tile);
+        minTileSpp = std::min(minTileSpp, tileSpp);
+        maxTileSpp = std::max(maxTileSpp, tileSpp);
+    }
+    std::cout << "Samples per pixel over tiles: " << minTileSpp << " to "
+              << maxTileSpp << std::endl;
     engine.getFilm()->writeToFile(out);
     return 0;
 }
@@ -16,4 +16,10 @@ surrounding_box(AABB box0, AABB box1)
     return AABB(a, b);
 }
 
+AABB
+surrounding_box(AABB box, const Point3 &p)
+{
+    return surrounding_box(box, AABB(p, p));
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -1,24 +1,135 @@
 #include "mrRay/film.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <memory>
 
 #include <OpenImageIO/imageio.h>
 
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
+// Checkpoints start with this, followed by the format version
+const char CHECKPOINT_MAGIC[4] = {'M', 'R', 'C', 'K'};
+const uint32_t CHECKPOINT_VERSION = 1;
+
+// Fixed size header of a checkpoint. The per pixel arrays follow it, in
+// the order of the members they are read into. Values are stored in the
+// byte order of the machine that wrote them.
+struct CheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t samplerType;
+    uint32_t frame;
+};
+
 void
-Film::writeTile(const Tile &tile)
+Film::addTile(const Tile &tile, const TileBuffer &buffer)
 {
-    std::unique_lock<std::mutex> lock(filmMutex);
     for (size_t j = 0; j < tile.height; ++j) {
         for (size_t i = 0; i < tile.width; ++i) {
             size_t filmIndex = (j + tile.top) * this->width + i + tile.left;
             size_t tileIndex = j * tile.width + i;
-            _colours[filmIndex] = tile.colours[tileIndex];
+            _sums[filmIndex] += buffer.colours[tileIndex];
+            _luminanceSquares[filmIndex] += buffer.luminanceSquares[tileIndex];
+            _sampleCounts[filmIndex] += buffer.sampleCounts[tileIndex];
+            if (_sampleCounts[filmIndex] > 0) {
+                _colours[filmIndex]
+                    = _sums[filmIndex] / _sampleCounts[filmIndex];
+            }
         }
     }
 }
 
+void
+Film::clear()
+{
+    std::unique_lock<std::mutex> lock(filmMutex);
+    for (size_t i = 0; i < width * height; ++i) {
+        _colours[i] = Colour(0, 0, 0);
+        _sums[i] = Colour(0, 0, 0);
+        _luminanceSquares[i] = 0;
+        _sampleCounts[i] = 0;
+        _converged[i] = false;
+    }
+}
+
+bool
+Film::updateConvergence(
+    const Tile &tile, double noiseThreshold, unsigned int minSamples)
+{
+    std::unique_lock<std::mutex> lock(filmMutex);
+
+    // The error is pooled over the whole tile. Per pixel estimates are too
+    // noisy at low sample counts: a pixel whose first few paths all missed
+    // the lights looks perfectly converged, which darkens the image
+    double errorSum = 0;
+    double luminanceSum = 0;
+    for (size_t j = tile.top; j < tile.top + tile.height; ++j) {
+        for (size_t i = tile.left; i < tile.left + tile.width; ++i) {
+            size_t index = j * width + i;
+            if (_converged[index]) continue;
+            unsigned int n = _sampleCounts[index];
+            if (n < minSamples || n < 2) return false;
+
+            double mean = luminance(_sums[index]) / n;
+            double variance
+                = std::max(0.0, _luminanceSquares[index] / n - mean * mean)
+                * n / (n - 1);
+            errorSum += std::sqrt(variance / n);
+            luminanceSum += mean;
+        }
+    }
+    if (errorSum > noiseThreshold * std::max(luminanceSum, 1e-3)) return false;
+
+    for (size_t j = tile.top; j < tile.top + tile.height; ++j) {
+        for (size_t i = tile.left; i < tile.left + tile.width; ++i) {
+            _converged[j * width + i] = true;
+        }
+    }
+    return true;
+}
+
+bool
+Film::isConverged(const Tile &tile) const
+{
+    for (size_t j = tile.top; j < tile.top + tile.height; ++j) {
+        for (size_t i = tile.left; i < tile.left + tile.width; ++i) {
+            if (!_converged[j * width + i]) return false;
+        }
+    }
+    return true;
+}
+
+double
+Film::averageSampleCount(const Tile &tile) const
+{
+    size_t total = 0;
+    for (size_t j = tile.top; j < tile.top + tile.height; ++j) {
+        for (size_t i = tile.left; i < tile.left + tile.width; ++i) {
+            total += _sampleCounts[j * width + i];
+        }
+    }
+    return total / (double)((size_t)tile.width * tile.height);
+}
+
+size_t
+Film::totalSamples()
+{
+    std::unique_lock<std::mutex> lock(filmMutex);
+    size_t total = 0;
+    for (size_t i = 0; i < width * height; ++i) {
+        total += _sampleCounts[i];
+    }
+    return total;
+}
+
 void
 Film::writeToFile(const std::string &path)
 {
@@ -41,6 +152,109 @@ Film::writeToFile(const std::string &path)
     out->close();
 }
 
+bool
+Film::writeCheckpoint(
+    const std::string &path, SamplerType samplerType, unsigned int frame)
+{
+    std::unique_lock<std::mutex> lock(filmMutex);
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.width = width;
+    header.height = height;
+    header.samplerType = (uint32_t)samplerType;
+    header.frame = frame;
+
+    size_t pixelCount = (size_t)width * height;
+    std::vector<uint8_t> converged(_converged, _converged + pixelCount);
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write((const char *)&header, sizeof(header));
+        out.write((const char *)_sums, sizeof(Colour) * pixelCount);
+        out.write(
+            (const char *)_luminanceSquares, sizeof(double) * pixelCount);
+        out.write(
+            (const char *)_sampleCounts, sizeof(unsigned int) * pixelCount);
+        out.write((const char *)converged.data(), pixelCount);
+        if (!out) {
+            std::cerr << "Could not write checkpoint: " << tempPath
+                      << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Could not replace checkpoint: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+Film::readCheckpoint(
+    const std::string &path, SamplerType samplerType, unsigned int frame)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    CheckpointHeader header;
+    in.read((char *)&header, sizeof(header));
+    if (!in
+        || std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))
+               != 0
+        || header.version != CHECKPOINT_VERSION)
+    {
+        std::cerr << "Not a checkpoint: " << path << std::endl;
+        return false;
+    }
+    if (header.width != width || header.height != height
+        || header.samplerType != (uint32_t)samplerType || header.frame != frame)
+    {
+        std::cerr << "Checkpoint was written by a different render: " << path
+                  << std::endl;
+        return false;
+    }
+
+    // Read everything before touching the film, so a truncated file
+    // doesn't leave it half loaded
+    size_t pixelCount = (size_t)width * height;
+    std::vector<Colour> sums(pixelCount);
+    std::vector<double> luminanceSquares(pixelCount);
+    std::vector<unsigned int> sampleCounts(pixelCount);
+    std::vector<uint8_t> converged(pixelCount);
+    in.read((char *)sums.data(), sizeof(Colour) * pixelCount);
+    in.read((char *)luminanceSquares.data(), sizeof(double) * pixelCount);
+    in.read((char *)sampleCounts.data(), sizeof(unsigned int) * pixelCount);
+    in.read((char *)converged.data(), pixelCount);
+    if (!in) {
+        std::cerr << "Checkpoint is truncated: " << path << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(filmMutex);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        _sums[i] = sums[i];
+        _luminanceSquares[i] = luminanceSquares[i];
+        _sampleCounts[i] = sampleCounts[i];
+        _converged[i] = converged[i] != 0;
+        _colours[i] = _sampleCounts[i] > 0 ? _sums[i] / _sampleCounts[i]
+                                           : Colour(0, 0, 0);
+    }
+    return true;
+}
+
+unsigned int
+Film::minSampleCount() const
+{
+    unsigned int minimum = std::numeric_limits<unsigned int>::max();
+    for (size_t i = 0; i < (size_t)width * height; ++i) {
+        if (!_converged[i]) minimum = std::min(minimum, _sampleCounts[i]);
+    }
+    return minimum;
+}
+
 Colour *
 Film::getData()
 {
@@ -22,10 +22,22 @@ XYRect::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
     Vec3 outward_normal(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
     rec.mat = mat.get();
+    rec.object = this;
     rec.p = r.at(t);
     return true;
 }
 
+bool
+XYRect::occluded(const Ray &r, double t_min, double t_max) const
+{
+    double t = (k - r.origin().z()) / r.direction().z();
+    if (t < t_min || t > t_max) return false;
+
+    double x = r.origin().x() + t * r.direction().x();
+    double y = r.origin().y() + t * r.direction().y();
+    return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+}
+
 bool
 XZRect::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
 {
@@ -46,10 +58,22 @@ XZRect::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
     Vec3 outward_normal(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
     rec.mat = mat.get();
+    rec.object = this;
     rec.p = r.at(t);
     return true;
 }
 
+bool
+XZRect::occluded(const Ray &r, double t_min, double t_max) const
+{
+    double t = (k - r.origin().y()) / r.direction().y();
+    if (t < t_min || t > t_max) return false;
+
+    double x = r.origin().x() + t * r.direction().x();
+    double z = r.origin().z() + t * r.direction().z();
+    return x >= x0 && x <= x1 && z >= z0 && z <= z1;
+}
+
 bool
 YZRect::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
 {
@@ -70,8 +94,20 @@ YZRect::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
     Vec3 outward_normal(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
     rec.mat = mat.get();
+    rec.object = this;
     rec.p = r.at(t);
     return true;
 }
 
+bool
+YZRect::occluded(const Ray &r, double t_min, double t_max) const
+{
+    double t = (k - r.origin().x()) / r.direction().x();
+    if (t < t_min || t > t_max) return false;
+
+    double y = r.origin().y() + t * r.direction().y();
+    double z = r.origin().z() + t * r.direction().z();
+    return y >= y0 && y <= y1 && z >= z0 && z <= z1;
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,939 @@
+#include "mrRay/geom/bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define MR_RAY_BVH_SSE
+    #include <immintrin.h>
+    #if defined(__GNUC__)
+        // AVX2 code is compiled per function, so the same binary still runs
+        // on CPUs without it
+        #define MR_RAY_BVH_AVX2
+        #define MR_RAY_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+// Cost of traversing a node, relative to the cost of intersecting a primitive
+const double BVH_TRAVERSAL_COST = 0.125;
+// Number of centroid bins evaluated when looking for an SAH split
+const int BVH_SAH_BUCKETS = 12;
+// Size of the traversal stack. Nodes deeper than half of this are split
+// into equal halves, which keeps the tree within the stack.
+const int BVH_STACK_SIZE = 64;
+// Leaves store their primitive count in 16 bits
+const size_t BVH_MAX_LEAF_PRIMS = 0xffff;
+// Scale applied to the far slab distance to absorb float rounding error
+const float BVH_SLAB_PADDING = 1.0000004f;
+// Subtrees with fewer primitives than this are always built on the
+// thread that reached them
+const size_t BVH_PARALLEL_BUILD_THRESHOLD = 4096;
+// Each level of a wide BVH can leave up to 7 siblings on the stack
+const int BVH_WIDE_STACK_SIZE = BVH_STACK_SIZE * 8;
+
+struct BVHPrimitiveInfo
+{
+    size_t primitiveNumber;
+    AABB bounds;
+    Point3 centroid;
+};
+
+// State shared by all threads taking part in a build. Every thread works
+// on a disjoint range of primitiveInfo, so the result is the same no
+// matter how many threads are used.
+struct BVHBuildState
+{
+    std::vector<BVHPrimitiveInfo> &primitiveInfo;
+    const BVHSettings &settings;
+    std::atomic<int> availableThreads;
+};
+
+struct BVHBucketInfo
+{
+    size_t count = 0;
+    AABB bounds = AABB::empty();
+};
+
+// Finds the partition point of the range [start, end) using binned SAH.
+// Returns start if the range should be turned into a leaf instead.
+static size_t
+findSAHSplit(
+    std::vector<BVHPrimitiveInfo> &primitiveInfo, size_t start, size_t end,
+    const AABB &bounds, const AABB &centroidBounds, int axis,
+    size_t maxPrimsInLeaf)
+{
+    // Bin the primitive centroids along the split axis
+    BVHBucketInfo buckets[BVH_SAH_BUCKETS];
+    auto bucketIndex = [&](const BVHPrimitiveInfo &info) {
+        int b = BVH_SAH_BUCKETS * centroidBounds.offset(info.centroid)[axis];
+        return b == BVH_SAH_BUCKETS ? BVH_SAH_BUCKETS - 1 : b;
+    };
+    for (size_t i = start; i < end; ++i) {
+        BVHBucketInfo &bucket = buckets[bucketIndex(primitiveInfo[i])];
+        bucket.count++;
+        bucket.bounds = surrounding_box(bucket.bounds, primitiveInfo[i].bounds);
+    }
+
+    // Sweep the buckets from both sides to get the cost of splitting
+    // after each one
+    double costs[BVH_SAH_BUCKETS - 1];
+    AABB below = AABB::empty();
+    size_t countBelow = 0;
+    for (int i = 0; i < BVH_SAH_BUCKETS - 1; ++i) {
+        below = surrounding_box(below, buckets[i].bounds);
+        countBelow += buckets[i].count;
+        costs[i] = countBelow * below.surfaceArea();
+    }
+    AABB above = AABB::empty();
+    size_t countAbove = 0;
+    for (int i = BVH_SAH_BUCKETS - 1; i > 0; --i) {
+        above = surrounding_box(above, buckets[i].bounds);
+        countAbove += buckets[i].count;
+        if (countAbove == 0 || countAbove == end - start) {
+            costs[i - 1] = infinity;
+            continue;
+        }
+        costs[i - 1] = BVH_TRAVERSAL_COST
+                     + (costs[i - 1] + countAbove * above.surfaceArea())
+                           / bounds.surfaceArea();
+    }
+
+    int minBucket = 0;
+    for (int i = 1; i < BVH_SAH_BUCKETS - 1; ++i) {
+        if (costs[i] < costs[minBucket]) minBucket = i;
+    }
+
+    // Only split if it is cheaper than intersecting every primitive, or
+    // if there are too many primitives for a single leaf
+    double leafCost = end - start;
+    if (end - start <= maxPrimsInLeaf && costs[minBucket] >= leafCost) {
+        return start;
+    }
+
+    auto mid = std::partition(
+        primitiveInfo.begin() + start,
+        primitiveInfo.begin() + end,
+        [&](const BVHPrimitiveInfo &info) {
+            return bucketIndex(info) <= minBucket;
+        });
+    return mid - primitiveInfo.begin();
+}
+
+// Claims one of the idle build threads, if there are any left
+static bool
+tryAcquireBuildThread(BVHBuildState &state)
+{
+    int available = state.availableThreads.load();
+    while (available > 0
+           && !state.availableThreads.compare_exchange_weak(
+               available, available - 1))
+    {
+    }
+    return available > 0;
+}
+
+static std::unique_ptr<BVHBuildNode>
+recursiveBuild(
+    BVHBuildState &state, size_t start, size_t end, int depth,
+    size_t &nodeCount)
+{
+    std::vector<BVHPrimitiveInfo> &primitiveInfo = state.primitiveInfo;
+    const BVHSettings &settings = state.settings;
+    std::unique_ptr<BVHBuildNode> node = std::make_unique<BVHBuildNode>();
+    nodeCount++;
+
+    AABB bounds = AABB::empty();
+    AABB centroidBounds = AABB::empty();
+    for (size_t i = start; i < end; ++i) {
+        bounds = surrounding_box(bounds, primitiveInfo[i].bounds);
+        centroidBounds
+            = surrounding_box(centroidBounds, primitiveInfo[i].centroid);
+    }
+    node->bounds = bounds;
+    node->firstPrimOffset = start;
+    node->nPrimitives = end - start;
+
+    size_t maxPrimsInLeaf
+        = std::min<size_t>(settings.maxPrimsInLeaf, BVH_MAX_LEAF_PRIMS);
+    if (end - start == 1) return node;
+
+    int axis = centroidBounds.maximumExtent();
+    size_t mid;
+    if (centroidBounds.max[axis] == centroidBounds.min[axis]) {
+        // All the centroids are in the same spot, so there is no better
+        // split than an arbitrary one
+        if (end - start <= maxPrimsInLeaf) return node;
+        mid = start + (end - start) / 2;
+    } else if (
+        settings.splitMethod == BVHSplitMethod::SAH
+        && depth < BVH_STACK_SIZE / 2)
+    {
+        mid = findSAHSplit(
+            primitiveInfo,
+            start,
+            end,
+            bounds,
+            centroidBounds,
+            axis,
+            maxPrimsInLeaf);
+        if (mid == start) return node;
+    } else {
+        mid = start + (end - start) / 2;
+        std::nth_element(
+            primitiveInfo.begin() + start,
+            primitiveInfo.begin() + mid,
+            primitiveInfo.begin() + end,
+            [axis](const BVHPrimitiveInfo &a, const BVHPrimitiveInfo &b) {
+                return a.centroid[axis] < b.centroid[axis];
+            });
+    }
+
+    node->nPrimitives = 0;
+    node->splitAxis = axis;
+    if (end - start >= BVH_PARALLEL_BUILD_THRESHOLD
+        && tryAcquireBuildThread(state))
+    {
+        // Hand the first child to another thread and build the second
+        // one on this thread
+        size_t firstNodeCount = 0;
+        std::thread firstChildThread([&]() {
+            node->children[0] = recursiveBuild(
+                state, start, mid, depth + 1, firstNodeCount);
+            state.availableThreads++;
+        });
+        node->children[1]
+            = recursiveBuild(state, mid, end, depth + 1, nodeCount);
+        firstChildThread.join();
+        nodeCount += firstNodeCount;
+    } else {
+        node->children[0]
+            = recursiveBuild(state, start, mid, depth + 1, nodeCount);
+        node->children[1]
+            = recursiveBuild(state, mid, end, depth + 1, nodeCount);
+    }
+    return node;
+}
+
+static double
+buildNodeSAHCost(const BVHBuildNode *node)
+{
+    double area = node->bounds.surfaceArea();
+    if (node->isLeaf()) return area * node->nPrimitives;
+    return area * BVH_TRAVERSAL_COST + buildNodeSAHCost(node->children[0].get())
+         + buildNodeSAHCost(node->children[1].get());
+}
+
+BVHTree::BVHTree()
+    : _empty(true)
+    , _width(2)
+    , _useAvx2(false)
+    , _sahCost(0)
+    , _builtTraversalCost(0)
+    , _traversalCost(0)
+{
+}
+
+std::vector<size_t>
+BVHTree::build(
+    const std::vector<AABB> &primitiveBounds, const BVHSettings &settings)
+{
+    _nodes.clear();
+    _nodes4.clear();
+    _nodes8.clear();
+    _empty = primitiveBounds.empty();
+    if (_empty) return {};
+
+    unsigned int buildThreads = std::max(settings.buildThreads, 1u);
+
+    std::vector<BVHPrimitiveInfo> primitiveInfo(primitiveBounds.size());
+    for (size_t i = 0; i < primitiveBounds.size(); ++i) {
+        primitiveInfo[i]
+            = {i, primitiveBounds[i], primitiveBounds[i].centroid()};
+    }
+
+    BVHBuildState state {primitiveInfo, settings, {(int)buildThreads - 1}};
+    size_t nodeCount = 0;
+    std::unique_ptr<BVHBuildNode> root
+        = recursiveBuild(state, 0, primitiveInfo.size(), 0, nodeCount);
+
+    _bounds = root->bounds;
+    double rootArea = root->bounds.surfaceArea();
+    _sahCost = rootArea > 0 ? buildNodeSAHCost(root.get()) / rootArea : 0;
+
+    switch (settings.width) {
+        case BVHWidth::Auto: _width = maxSupportedWidth(); break;
+        case BVHWidth::Binary: _width = 2; break;
+        case BVHWidth::Four: _width = 4; break;
+        case BVHWidth::Eight: _width = 8; break;
+    }
+    _useAvx2 = _width == 8 && maxSupportedWidth() == 8;
+
+    if (_width == 8) {
+        collapse<8>(root.get(), _nodes8);
+    } else if (_width == 4) {
+        collapse<4>(root.get(), _nodes4);
+    } else {
+        _nodes.reserve(nodeCount);
+        flatten(root.get());
+    }
+
+    _traversalCost = traversalCost(primitiveBounds);
+    _builtTraversalCost = _traversalCost;
+
+    // Leaves reference ranges of the partitioned primitive info, so that
+    // is the order the primitives must be stored in
+    std::vector<size_t> order;
+    order.reserve(primitiveInfo.size());
+    for (const BVHPrimitiveInfo &info: primitiveInfo) {
+        order.push_back(info.primitiveNumber);
+    }
+    return order;
+}
+
+int
+BVHTree::maxSupportedWidth()
+{
+#if defined(MR_RAY_BVH_AVX2)
+    if (__builtin_cpu_supports("avx2")) return 8;
+#endif
+#if defined(MR_RAY_BVH_SSE)
+    return 4;
+#else
+    return 2;
+#endif
+}
+
+size_t
+BVHTree::nodeCount() const
+{
+    if (_width == 8) return _nodes8.size();
+    if (_width == 4) return _nodes4.size();
+    return _nodes.size();
+}
+
+// Bounds are rounded outwards so the float box always contains the
+// double one
+static inline float
+roundDown(double value)
+{
+    return std::nextafter((float)value, -HUGE_VALF);
+}
+
+static inline float
+roundUp(double value)
+{
+    return std::nextafter((float)value, HUGE_VALF);
+}
+
+uint32_t
+BVHTree::flatten(const BVHBuildNode *node)
+{
+    uint32_t offset = _nodes.size();
+    _nodes.emplace_back();
+    for (int a = 0; a < 3; ++a) {
+        _nodes[offset].boundsMin[a] = roundDown(node->bounds.min[a]);
+        _nodes[offset].boundsMax[a] = roundUp(node->bounds.max[a]);
+    }
+    _nodes[offset].pad = 0;
+
+    if (node->isLeaf()) {
+        _nodes[offset].primitivesOffset = node->firstPrimOffset;
+        _nodes[offset].nPrimitives = node->nPrimitives;
+        _nodes[offset].axis = 0;
+    } else {
+        _nodes[offset].nPrimitives = 0;
+        _nodes[offset].axis = node->splitAxis;
+        flatten(node->children[0].get());
+        _nodes[offset].secondChildOffset = flatten(node->children[1].get());
+    }
+    return offset;
+}
+
+template <int N>
+uint32_t
+BVHTree::collapse(const BVHBuildNode *node, std::vector<WideBVHNode<N>> &nodes)
+{
+    // Keep opening the interior child with the largest surface area until
+    // the node is full, as that child is the most likely to be visited
+    const BVHBuildNode *children[N];
+    int childCount = 0;
+    if (node->isLeaf()) {
+        children[childCount++] = node;
+    } else {
+        children[childCount++] = node->children[0].get();
+        children[childCount++] = node->children[1].get();
+    }
+    while (childCount < N) {
+        int largest = -1;
+        for (int i = 0; i < childCount; ++i) {
+            if (children[i]->isLeaf()) continue;
+            if (largest < 0
+                || children[i]->bounds.surfaceArea()
+                       > children[largest]->bounds.surfaceArea())
+            {
+                largest = i;
+            }
+        }
+        if (largest < 0) break;
+        const BVHBuildNode *opened = children[largest];
+        children[largest] = opened->children[0].get();
+        children[childCount++] = opened->children[1].get();
+    }
+
+    uint32_t offset = nodes.size();
+    nodes.emplace_back();
+    WideBVHNode<N> wideNode;
+    wideNode.childCount = childCount;
+    for (int i = 0; i < N; ++i) {
+        // Unused children get inverted bounds so they can never be hit
+        for (int a = 0; a < 3; ++a) {
+            wideNode.boundsMin[a][i]
+                = i < childCount ? roundDown(children[i]->bounds.min[a])
+                                 : HUGE_VALF;
+            wideNode.boundsMax[a][i]
+                = i < childCount ? roundUp(children[i]->bounds.max[a])
+                                 : -HUGE_VALF;
+        }
+        wideNode.children[i] = 0;
+        wideNode.nPrimitives[i] = 0;
+        if (i >= childCount) continue;
+        if (children[i]->isLeaf()) {
+            wideNode.children[i] = children[i]->firstPrimOffset;
+            wideNode.nPrimitives[i] = children[i]->nPrimitives;
+        } else {
+            wideNode.children[i] = collapse<N>(children[i], nodes);
+        }
+    }
+    nodes[offset] = wideNode;
+    return offset;
+}
+
+static AABB
+slotRangeBounds(
+    const std::vector<AABB> &slotBounds, uint32_t first, uint32_t count)
+{
+    AABB bounds = AABB::empty();
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds = surrounding_box(bounds, slotBounds[i]);
+    }
+    return bounds;
+}
+
+// Children are always stored after their parent, so visiting the nodes in
+// reverse order refits every child before the node that contains it.
+// Returns the new bounds of the root.
+static AABB
+refitBinary(
+    std::vector<LinearBVHNode> &nodes, const std::vector<AABB> &slotBounds)
+{
+    std::vector<AABB> nodeBounds(nodes.size());
+    for (size_t i = nodes.size(); i-- > 0;) {
+        LinearBVHNode &node = nodes[i];
+        if (node.nPrimitives > 0) {
+            nodeBounds[i] = slotRangeBounds(
+                slotBounds, node.primitivesOffset, node.nPrimitives);
+        } else {
+            nodeBounds[i] = surrounding_box(
+                nodeBounds[i + 1], nodeBounds[node.secondChildOffset]);
+        }
+        for (int a = 0; a < 3; ++a) {
+            node.boundsMin[a] = roundDown(nodeBounds[i].min[a]);
+            node.boundsMax[a] = roundUp(nodeBounds[i].max[a]);
+        }
+    }
+    return nodeBounds[0];
+}
+
+template <int N>
+static AABB
+refitWide(
+    std::vector<WideBVHNode<N>> &nodes, const std::vector<AABB> &slotBounds)
+{
+    std::vector<AABB> nodeBounds(nodes.size());
+    for (size_t i = nodes.size(); i-- > 0;) {
+        WideBVHNode<N> &node = nodes[i];
+        AABB bounds = AABB::empty();
+        for (int c = 0; c < node.childCount; ++c) {
+            AABB childBounds = node.nPrimitives[c] > 0
+                                 ? slotRangeBounds(
+                                     slotBounds,
+                                     node.children[c],
+                                     node.nPrimitives[c])
+                                 : nodeBounds[node.children[c]];
+            for (int a = 0; a < 3; ++a) {
+                node.boundsMin[a][c] = roundDown(childBounds.min[a]);
+                node.boundsMax[a][c] = roundUp(childBounds.max[a]);
+            }
+            bounds = surrounding_box(bounds, childBounds);
+        }
+        nodeBounds[i] = bounds;
+    }
+    return nodeBounds[0];
+}
+
+void
+BVHTree::refitBounds(const std::vector<AABB> &slotBounds)
+{
+    if (_empty) return;
+    if (_width == 8) {
+        _bounds = refitWide<8>(_nodes8, slotBounds);
+    } else if (_width == 4) {
+        _bounds = refitWide<4>(_nodes4, slotBounds);
+    } else {
+        _bounds = refitBinary(_nodes, slotBounds);
+    }
+    _traversalCost = traversalCost(slotBounds);
+}
+
+static inline double
+boxArea(float dx, float dy, float dz)
+{
+    return 2.0 * ((double)dx * dy + (double)dy * dz + (double)dz * dx);
+}
+
+double
+BVHTree::traversalCost(const std::vector<AABB> &primitiveBounds) const
+{
+    // Same cost model as the build, but over the nodes that are actually
+    // traversed, so it also covers collapsed trees. It is normalized by the
+    // area of the primitives rather than of the root, as the root grows
+    // along with the nodes when primitives spread apart.
+    double primitiveArea = 0;
+    for (const AABB &bounds: primitiveBounds) {
+        primitiveArea += bounds.surfaceArea();
+    }
+    double rootArea = _bounds.surfaceArea();
+    if (_empty || primitiveArea <= 0) return 0;
+
+    double cost = 0;
+    auto addWide = [&](const auto &nodes) {
+        cost += rootArea * BVH_TRAVERSAL_COST;
+        for (const auto &node: nodes) {
+            for (int c = 0; c < node.childCount; ++c) {
+                double area = boxArea(
+                    node.boundsMax[0][c] - node.boundsMin[0][c],
+                    node.boundsMax[1][c] - node.boundsMin[1][c],
+                    node.boundsMax[2][c] - node.boundsMin[2][c]);
+                cost += area
+                      * (node.nPrimitives[c] > 0 ? node.nPrimitives[c]
+                                                 : BVH_TRAVERSAL_COST);
+            }
+        }
+    };
+    if (_width == 8) {
+        addWide(_nodes8);
+    } else if (_width == 4) {
+        addWide(_nodes4);
+    } else {
+        for (const LinearBVHNode &node: _nodes) {
+            double area = boxArea(
+                node.boundsMax[0] - node.boundsMin[0],
+                node.boundsMax[1] - node.boundsMin[1],
+                node.boundsMax[2] - node.boundsMin[2]);
+            cost += area
+                  * (node.nPrimitives > 0 ? node.nPrimitives
+                                          : BVH_TRAVERSAL_COST);
+        }
+    }
+    return cost / primitiveArea;
+}
+
+double
+BVHTree::refitCostRatio() const
+{
+    return _builtTraversalCost > 0 ? _traversalCost / _builtTraversalCost : 1;
+}
+
+// Slab test against a node's bounds. The far distance is padded slightly
+// to make up for float rounding, so a hit is never missed.
+static inline bool
+hitNodeBounds(
+    const LinearBVHNode &node, const float origin[3], const float invDir[3],
+    const int dirIsNeg[3], float tMin, float tMax)
+{
+    const float *bounds[2] = {node.boundsMin, node.boundsMax};
+    for (int a = 0; a < 3; ++a) {
+        float t0 = (bounds[dirIsNeg[a]][a] - origin[a]) * invDir[a];
+        float t1 = (bounds[1 - dirIsNeg[a]][a] - origin[a]) * invDir[a];
+        t1 *= BVH_SLAB_PADDING;
+        tMin = t0 > tMin ? t0 : tMin;
+        tMax = t1 < tMax ? t1 : tMax;
+        if (tMin > tMax) return false;
+    }
+    return true;
+}
+
+struct BVHStackEntry
+{
+    uint32_t index;
+    uint16_t nPrimitives;
+    float tNear;
+};
+
+// Slab tests a ray against every child of a wide node. Returns a bit mask
+// of the children that were hit and writes their entry distances to tNear.
+template <int N>
+static inline int
+hitChildBounds(
+    const WideBVHNode<N> &node, const float origin[3], const float invDir[3],
+    const int dirIsNeg[3], float tMin, float tMax, float tNear[N])
+{
+    int mask = 0;
+    for (int i = 0; i < node.childCount; ++i) {
+        float t0 = tMin;
+        float t1 = tMax;
+        for (int a = 0; a < 3; ++a) {
+            const float *bounds[2] = {node.boundsMin[a], node.boundsMax[a]};
+            float tEnter = (bounds[dirIsNeg[a]][i] - origin[a]) * invDir[a];
+            float tExit = (bounds[1 - dirIsNeg[a]][i] - origin[a]) * invDir[a];
+            tExit *= BVH_SLAB_PADDING;
+            t0 = tEnter > t0 ? tEnter : t0;
+            t1 = tExit < t1 ? tExit : t1;
+        }
+        tNear[i] = t0;
+        if (t0 <= t1) mask |= 1 << i;
+    }
+    return mask;
+}
+
+#if defined(MR_RAY_BVH_SSE)
+template <>
+inline int
+hitChildBounds<4>(
+    const WideBVHNode<4> &node, const float origin[3], const float invDir[3],
+    const int dirIsNeg[3], float tMin, float tMax, float tNear[4])
+{
+    // Operands are ordered so that NaNs from 0 * inf are ignored, the same
+    // as in the scalar test
+    __m128 t0 = _mm_set1_ps(tMin);
+    __m128 t1 = _mm_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        const float *bounds[2] = {node.boundsMin[a], node.boundsMax[a]};
+        __m128 o = _mm_set1_ps(origin[a]);
+        __m128 inv = _mm_set1_ps(invDir[a]);
+        __m128 tEnter = _mm_mul_ps(
+            _mm_sub_ps(_mm_load_ps(bounds[dirIsNeg[a]]), o), inv);
+        __m128 tExit = _mm_mul_ps(
+            _mm_sub_ps(_mm_load_ps(bounds[1 - dirIsNeg[a]]), o), inv);
+        tExit = _mm_mul_ps(tExit, _mm_set1_ps(BVH_SLAB_PADDING));
+        t0 = _mm_max_ps(tEnter, t0);
+        t1 = _mm_min_ps(tExit, t1);
+    }
+    _mm_storeu_ps(tNear, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+#if defined(MR_RAY_BVH_AVX2)
+MR_RAY_TARGET_AVX2 static inline int
+hitChildBoundsAvx2(
+    const WideBVHNode<8> &node, const float origin[3], const float invDir[3],
+    const int dirIsNeg[3], float tMin, float tMax, float tNear[8])
+{
+    __m256 t0 = _mm256_set1_ps(tMin);
+    __m256 t1 = _mm256_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        const float *bounds[2] = {node.boundsMin[a], node.boundsMax[a]};
+        __m256 o = _mm256_set1_ps(origin[a]);
+        __m256 inv = _mm256_set1_ps(invDir[a]);
+        __m256 tEnter = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(bounds[dirIsNeg[a]]), o), inv);
+        __m256 tExit = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(bounds[1 - dirIsNeg[a]]), o), inv);
+        tExit = _mm256_mul_ps(tExit, _mm256_set1_ps(BVH_SLAB_PADDING));
+        t0 = _mm256_max_ps(tEnter, t0);
+        t1 = _mm256_min_ps(tExit, t1);
+    }
+    _mm256_storeu_ps(tNear, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+// Traverses a wide BVH. AnyHit traversals return as soon as any primitive
+// is hit and leave rec untouched, so it may be null.
+template <
+    int N,
+    int (*HitChildBounds)(
+        const WideBVHNode<N> &, const float[3], const float[3], const int[3],
+        float, float, float[N]),
+    bool AnyHit>
+static inline bool
+traverseWide(
+    const std::vector<WideBVHNode<N>> &nodes, const BVHTree &tree,
+    const Ray &r, double t_min, double t_max, hit_record *rec)
+{
+    float origin[3], invDir[3];
+    int dirIsNeg[3];
+    for (int a = 0; a < 3; ++a) {
+        origin[a] = r.origin()[a];
+        invDir[a] = 1.f / (float)r.direction()[a];
+        dirIsNeg[a] = invDir[a] < 0;
+    }
+
+    bool hitAnything = false;
+    BVHStackEntry stack[BVH_WIDE_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = {0, 0, (float)t_min};
+    while (stackSize > 0) {
+        BVHStackEntry entry = stack[--stackSize];
+        // Skip anything that starts behind the closest hit found so far
+        if (entry.tNear > t_max) continue;
+
+        if (entry.nPrimitives > 0) {
+            if (AnyHit) {
+                if (tree.occludedPrimitives(
+                        entry.index, entry.nPrimitives, r, t_min, t_max))
+                {
+                    return true;
+                }
+            } else if (tree.hitPrimitives(
+                           entry.index, entry.nPrimitives, r, t_min, t_max,
+                           *rec))
+            {
+                hitAnything = true;
+                t_max = rec->t;
+            }
+            continue;
+        }
+
+        const WideBVHNode<N> &node = nodes[entry.index];
+        float tNear[N];
+        int mask = HitChildBounds(
+            node, origin, invDir, dirIsNeg, t_min, t_max, tNear);
+        mask &= (1 << node.childCount) - 1;
+
+        // Push the children that were hit, furthest first, so the nearest
+        // one is visited next
+        int first = stackSize;
+        for (int i = 0; i < N; ++i) {
+            if (!(mask & (1 << i))) continue;
+            BVHStackEntry child = {
+                node.children[i], node.nPrimitives[i], tNear[i]};
+            int j = stackSize++;
+            while (j > first && stack[j - 1].tNear < child.tNear) {
+                stack[j] = stack[j - 1];
+                --j;
+            }
+            stack[j] = child;
+        }
+    }
+    return hitAnything;
+}
+
+#if defined(MR_RAY_BVH_AVX2)
+// Flattened so the AVX2 slab test is inlined into the traversal loop
+template <bool AnyHit>
+MR_RAY_TARGET_AVX2 __attribute__((flatten)) static bool
+hitWide8Avx2(
+    const std::vector<WideBVHNode<8>> &nodes, const BVHTree &tree,
+    const Ray &r, double t_min, double t_max, hit_record *rec)
+{
+    return traverseWide<8, hitChildBoundsAvx2, AnyHit>(
+        nodes, tree, r, t_min, t_max, rec);
+}
+#endif
+
+// Traverses a binary BVH, with the same AnyHit behaviour as traverseWide
+template <bool AnyHit>
+static bool
+traverseBinary(
+    const std::vector<LinearBVHNode> &nodes, const BVHTree &tree,
+    const Ray &r, double t_min, double t_max, hit_record *rec)
+{
+    float origin[3], invDir[3];
+    int dirIsNeg[3];
+    for (int a = 0; a < 3; ++a) {
+        origin[a] = r.origin()[a];
+        invDir[a] = 1.f / (float)r.direction()[a];
+        dirIsNeg[a] = invDir[a] < 0;
+    }
+
+    bool hitAnything = false;
+    uint32_t nodesToVisit[BVH_STACK_SIZE];
+    int toVisitOffset = 0;
+    uint32_t currentNodeIndex = 0;
+    while (true) {
+        const LinearBVHNode &node = nodes[currentNodeIndex];
+        if (hitNodeBounds(node, origin, invDir, dirIsNeg, t_min, t_max)) {
+            if (node.nPrimitives > 0) {
+                if (AnyHit) {
+                    if (tree.occludedPrimitives(
+                            node.primitivesOffset, node.nPrimitives, r, t_min,
+                            t_max))
+                    {
+                        return true;
+                    }
+                } else if (tree.hitPrimitives(
+                               node.primitivesOffset, node.nPrimitives, r,
+                               t_min, t_max, *rec))
+                {
+                    hitAnything = true;
+                    t_max = rec->t;
+                }
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                // Visit the child closest to the ray origin first so the
+                // far child can be culled against the nearer hit
+                if (dirIsNeg[node.axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node.secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node.secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0) break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    return hitAnything;
+}
+
+template <bool AnyHit>
+static bool
+traverse(
+    int width, bool useAvx2, const std::vector<LinearBVHNode> &nodes,
+    const std::vector<WideBVHNode<4>> &nodes4,
+    const std::vector<WideBVHNode<8>> &nodes8, const BVHTree &tree,
+    const Ray &r, double t_min, double t_max, hit_record *rec)
+{
+    if (width == 8) {
+        if (nodes8.empty()) return false;
+#if defined(MR_RAY_BVH_AVX2)
+        if (useAvx2) {
+            return hitWide8Avx2<AnyHit>(nodes8, tree, r, t_min, t_max, rec);
+        }
+#endif
+        return traverseWide<8, hitChildBounds<8>, AnyHit>(
+            nodes8, tree, r, t_min, t_max, rec);
+    }
+    if (width == 4) {
+        if (nodes4.empty()) return false;
+        return traverseWide<4, hitChildBounds<4>, AnyHit>(
+            nodes4, tree, r, t_min, t_max, rec);
+    }
+    if (nodes.empty()) return false;
+    return traverseBinary<AnyHit>(nodes, tree, r, t_min, t_max, rec);
+}
+
+bool
+BVHTree::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    return traverse<false>(
+        _width,
+        _useAvx2,
+        _nodes,
+        _nodes4,
+        _nodes8,
+        *this,
+        r,
+        t_min,
+        t_max,
+        &rec);
+}
+
+bool
+BVHTree::occluded(const Ray &r, double t_min, double t_max) const
+{
+    return traverse<true>(
+        _width,
+        _useAvx2,
+        _nodes,
+        _nodes4,
+        _nodes8,
+        *this,
+        r,
+        t_min,
+        t_max,
+        nullptr);
+}
+
+bool
+BVHTree::bounding_box(double time0, double time1, AABB &output_box) const
+{
+    if (_empty) return false;
+    output_box = _bounds;
+    return true;
+}
+
+BVH::BVH(
+    const std::vector<std::shared_ptr<Hittable>> &primitives,
+    const BVHSettings &settings)
+{
+    unsigned int buildThreads = std::max(settings.buildThreads, 1u);
+
+    // Gather primitive bounds, split into one chunk per build thread
+    std::vector<AABB> primitiveBounds(primitives.size());
+    auto gatherPrimitiveBounds = [&](size_t start, size_t end) {
+        for (size_t i = start; i < end; ++i) {
+            if (!primitives[i]->bounding_box(0, 0, primitiveBounds[i]))
+                std::cerr << "Bounding box definition missing. Found in BVH "
+                             "build";
+        }
+    };
+    if (buildThreads > 1 && primitives.size() >= BVH_PARALLEL_BUILD_THRESHOLD) {
+        std::vector<std::thread> threads;
+        size_t chunkSize = (primitives.size() + buildThreads - 1) / buildThreads;
+        for (size_t start = 0; start < primitives.size(); start += chunkSize) {
+            threads.emplace_back(
+                gatherPrimitiveBounds,
+                start,
+                std::min(start + chunkSize, primitives.size()));
+        }
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+    } else {
+        gatherPrimitiveBounds(0, primitives.size());
+    }
+
+    std::vector<size_t> order = build(primitiveBounds, settings);
+    _primitives.reserve(order.size());
+    for (size_t index: order) {
+        _primitives.push_back(primitives[index]);
+    }
+}
+
+void
+BVH::refit()
+{
+    std::vector<AABB> slotBounds(_primitives.size());
+    for (size_t i = 0; i < _primitives.size(); ++i) {
+        _primitives[i]->bounding_box(0, 0, slotBounds[i]);
+    }
+    refitBounds(slotBounds);
+}
+
+bool
+BVH::hitPrimitives(
+    uint32_t first, uint32_t count, const Ray &r, double t_min, double t_max,
+    hit_record &rec) const
+{
+    bool hitAnything = false;
+    for (uint32_t i = first; i < first + count; ++i) {
+        if (_primitives[i]->hit(r, t_min, t_max, rec)) {
+            hitAnything = true;
+            t_max = rec.t;
+        }
+    }
+    return hitAnything;
+}
+
+bool
+BVH::occludedPrimitives(
+    uint32_t first, uint32_t count, const Ray &r, double t_min,
+    double t_max) const
+{
+    for (uint32_t i = first; i < first + count; ++i) {
+        if (_primitives[i]->occluded(r, t_min, t_max)) return true;
+    }
+    return false;
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -31,7 +31,47 @@ Disk::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
     // Set normal and material
     rec.set_face_normal(r, Vec3(0, 1, 0));
     rec.mat = mat.get();
+    rec.object = this;
     return true;
 }
 
+bool
+Disk::occluded(const Ray &r, double t_min, double t_max) const
+{
+    double t = (center.y() - r.origin().y()) / r.dir.y();
+    if (t > t_max || t < t_min) return false;
+
+    Point3 hitPoint = r.at(t);
+    float dist2 = (hitPoint.x() - center.x()) * (hitPoint.x() - center.x())
+                + (hitPoint.z() - center.z()) * (hitPoint.z() - center.z());
+    return dist2 <= radius * radius && dist2 >= innerRadius * innerRadius;
+}
+
+double
+Disk::pdf_value(const Point3 &o, const Vec3 &direction) const
+{
+    hit_record rec;
+    if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
+        return 0;
+    }
+
+    double area = pi * (radius * radius - innerRadius * innerRadius);
+    double distanceSquared = rec.t * rec.t * direction.length_squared();
+    double cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+    return distanceSquared / (cosine * area);
+}
+
+Vec3
+Disk::random(const Vec3 &o, Sampler &sampler) const
+{
+    // Uniformly sample the area between the inner and outer radius
+    double innerSquared = innerRadius * innerRadius;
+    double r = sqrt(
+        innerSquared + sampler.getDouble() * (radius * radius - innerSquared));
+    double phi = 2 * pi * sampler.getDouble();
+    Point3 randomPoint = center + Vec3(r * cos(phi), 0, r * sin(phi));
+    return unit_vector(randomPoint - o);
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -20,6 +20,15 @@ HittableList::hit(const Ray &r, double t_min, double t_max, hit_record &rec) con
     return hit_anything;
 }
 
+bool
+HittableList::occluded(const Ray &r, double t_min, double t_max) const
+{
+    for (const std::shared_ptr<Hittable> &object: objects) {
+        if (object->occluded(r, t_min, t_max)) return true;
+    }
+    return false;
+}
+
 bool
 HittableList::bounding_box(double time0, double time1, AABB &output_box) const
 {
@@ -0,0 +1,67 @@
+#include "mrRay/geom/instance.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+Instance::Instance(std::shared_ptr<Hittable> prototype, const Mat4 &objToWorld)
+    : _prototype(prototype)
+    , _objToWorld(objToWorld)
+    , _worldToObj(objToWorld.inverse())
+{
+}
+
+bool
+Instance::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    // The direction is left unnormalized so that t means the same along
+    // the object space ray as it does along r
+    Ray objectRay(
+        _worldToObj.transformPoint(r.origin()),
+        _worldToObj.transformVector(r.direction()));
+    if (!_prototype->hit(objectRay, t_min, t_max, rec)) return false;
+
+    // Normals move by the inverse transpose of the object's transform
+    Vec3 outwardNormal = rec.front_face ? rec.normal : -rec.normal;
+    rec.p = r.at(rec.t);
+    rec.set_face_normal(
+        r, unit_vector(_worldToObj.transformNormal(outwardNormal)));
+    rec.object = this;
+    return true;
+}
+
+bool
+Instance::occluded(const Ray &r, double t_min, double t_max) const
+{
+    Ray objectRay(
+        _worldToObj.transformPoint(r.origin()),
+        _worldToObj.transformVector(r.direction()));
+    return _prototype->occluded(objectRay, t_min, t_max);
+}
+
+bool
+Instance::bounding_box(double time0, double time1, AABB &output_box) const
+{
+    AABB objectBox;
+    if (!_prototype->bounding_box(time0, time1, objectBox)) return false;
+
+    // Bound the transformed corners of the prototype's box
+    output_box = AABB::empty();
+    for (int i = 0; i < 8; i++) {
+        Point3 corner(
+            i & 1 ? objectBox.max.x() : objectBox.min.x(),
+            i & 2 ? objectBox.max.y() : objectBox.min.y(),
+            i & 4 ? objectBox.max.z() : objectBox.min.z());
+        output_box
+            = surrounding_box(output_box, _objToWorld.transformPoint(corner));
+    }
+    return true;
+}
+
+void
+Instance::prepare(const BVHSettings &bvhSettings)
+{
+    // Shared prototypes are prepared once per instance, so they are expected
+    // to skip work they have already done
+    _prototype->prepare(bvhSettings);
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
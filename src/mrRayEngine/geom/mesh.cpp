@@ -1,5 +1,4 @@
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 
 #include "mrRay/geom/mesh.h"
 
@@ -8,80 +7,303 @@ MR_RAY_NAMESPACE_OPEN_SCOPE
 Mesh::Mesh(
     const RawMeshInfo &meshInfo, const Mat4 &objToWorld,
     const bool &smoothShading, std::shared_ptr<Material> mat)
-    : smoothShading(smoothShading)
-    , mat(mat)
-    , _triangles(std::make_unique<HittableList>())
+    : mat(mat)
+    , smoothShading(smoothShading)
+    , _treeBuilt(false)
 {
     size_t positionCount = meshInfo.positions.size();
-    positions = new Vec3[positionCount];
+    _positionsX.resize(positionCount);
+    _positionsY.resize(positionCount);
+    _positionsZ.resize(positionCount);
     for (int i = 0; i < positionCount; i++) {
-        Vec3 position = meshInfo.positions[i];
-        // TODO: Matrix multiplication should be implemented elsewhere
-        positions[i] = Vec3(
-            (objToWorld[0] * position[0]) + (objToWorld[1] * position[1])
-                + (objToWorld[2] * position[2]) + objToWorld[3],
-            (objToWorld[4] * position[0]) + (objToWorld[5] * position[1])
-                + (objToWorld[6] * position[2]) + objToWorld[7],
-            (objToWorld[8] * position[0]) + (objToWorld[9] * position[1])
-                + (objToWorld[10] * position[2]) + objToWorld[11]);
-    }
-
-    size_t normalCount = meshInfo.normals.size();
-    normals = new Vec3[normalCount];
-    std::copy(meshInfo.normals.begin(), meshInfo.normals.end(), normals);
-
-    size_t uvCount = meshInfo.uvs.size();
-    uvs = new Vec3[uvCount];
-    std::copy(meshInfo.uvs.begin(), meshInfo.uvs.end(), uvs);
-
-    size_t positionIndexCount = meshInfo.positionIndices.size();
-    positionIndices = new int[positionIndexCount];
-    std::copy(
-        meshInfo.positionIndices.begin(),
-        meshInfo.positionIndices.end(),
-        positionIndices);
-
-    size_t normalIndexCount = meshInfo.normalIndices.size();
-    normalIndices = new int[normalIndexCount];
-    std::copy(
-        meshInfo.normalIndices.begin(),
-        meshInfo.normalIndices.end(),
-        normalIndices);
-
-    size_t uvIndexCount = meshInfo.uvIndices.size();
-    uvIndices = new int[uvIndexCount];
-    std::copy(meshInfo.uvIndices.begin(), meshInfo.uvIndices.end(), uvIndices);
-
-    faceCount = positionIndexCount / 3;
-    normalsDefined = !meshInfo.normals.empty();
-    uvsDefined = !meshInfo.uvs.empty();
+        Point3 position = objToWorld.transformPoint(meshInfo.positions[i]);
+        _positionsX[i] = position[0];
+        _positionsY[i] = position[1];
+        _positionsZ[i] = position[2];
+    }
+
+    _normals.reserve(meshInfo.normals.size() * 3);
+    for (const Vec3 &normal: meshInfo.normals) {
+        _normals.push_back(normal[0]);
+        _normals.push_back(normal[1]);
+        _normals.push_back(normal[2]);
+    }
+    _uvs.reserve(meshInfo.uvs.size() * 2);
+    for (const Vec3 &uv: meshInfo.uvs) {
+        _uvs.push_back(uv[0]);
+        _uvs.push_back(uv[1]);
+    }
+
+    _faceCount = meshInfo.positionIndices.size() / 3;
+    _normalsDefined = !meshInfo.normals.empty();
+    _uvsDefined = !meshInfo.uvs.empty();
+
+    _positionIndices = meshInfo.positionIndices;
+    if (_normalsDefined) _normalIndices = meshInfo.normalIndices;
+    if (_uvsDefined) _uvIndices = meshInfo.uvIndices;
+}
+
+void
+Mesh::prepare(const BVHSettings &bvhSettings)
+{
+    // The build thread count and refit threshold are taken on even when the
+    // tree is kept, as they don't change it
+    bool rebuild = !_treeBuilt || bvhSettings != _bvhSettings;
+    _bvhSettings = bvhSettings;
+    if (rebuild) buildTree();
 }
 
-Mesh::~Mesh()
+AABB
+Mesh::getTriangleBounds(size_t triangle) const
 {
-    delete[] positions;
-    delete[] normals;
-    delete[] uvs;
-    delete[] positionIndices;
-    delete[] normalIndices;
-    delete[] uvIndices;
+    const int *index = &_positionIndices[triangle * 3];
+    Vec3 v0 = getPosition(index[0]);
+    Vec3 v1 = getPosition(index[1]);
+    Vec3 v2 = getPosition(index[2]);
+    return AABB(
+        Point3(
+            fmin(fmin(v0.e[0], v1.e[0]), v2.e[0]),
+            fmin(fmin(v0.e[1], v1.e[1]), v2.e[1]),
+            fmin(fmin(v0.e[2], v1.e[2]), v2.e[2])),
+        Point3(
+            fmax(fmax(v0.e[0], v1.e[0]), v2.e[0]),
+            fmax(fmax(v0.e[1], v1.e[1]), v2.e[1]),
+            fmax(fmax(v0.e[2], v1.e[2]), v2.e[2])));
 }
 
-HittableList *
-Mesh::getTriangles()
+void
+Mesh::buildTree()
 {
-    if (!_triangles->objects.empty()) {
-        return _triangles.get();
-    }
-    for (size_t i = 0; i < faceCount; i++) {
-        size_t offset = i * 3;
-        int *normalIndex = normalsDefined ? normalIndices + offset : nullptr;
-        int *uvIndex = uvsDefined ? uvIndices + offset : nullptr;
-        std::shared_ptr<Triangle> tri = std::make_shared<Triangle>(
-            positionIndices + offset, normalIndex, uvIndex, this, mat);
-        _triangles->add(tri);
-    }
-    return _triangles.get();
+    std::vector<AABB> triangleBounds(_faceCount);
+    for (size_t i = 0; i < _faceCount; i++) {
+        triangleBounds[i] = getTriangleBounds(i);
+    }
+
+    // Store the index buffers in leaf order, so that a leaf's triangles are
+    // next to each other in memory
+    std::vector<size_t> order = build(triangleBounds, _bvhSettings);
+    auto reorder = [&](std::vector<int> &indices, bool defined) {
+        if (!defined) return;
+        std::vector<int> reordered;
+        reordered.reserve(_faceCount * 3);
+        for (size_t triangle: order) {
+            reordered.push_back(indices[triangle * 3]);
+            reordered.push_back(indices[triangle * 3 + 1]);
+            reordered.push_back(indices[triangle * 3 + 2]);
+        }
+        indices.swap(reordered);
+    };
+    reorder(_positionIndices, true);
+    reorder(_normalIndices, _normalsDefined);
+    reorder(_uvIndices, _uvsDefined);
+    _treeBuilt = true;
+}
+
+void
+Mesh::setPositions(const std::vector<Vec3> &positions, const Mat4 &objToWorld)
+{
+    for (size_t i = 0; i < positions.size() && i < _positionsX.size(); i++) {
+        Point3 position = objToWorld.transformPoint(positions[i]);
+        _positionsX[i] = position[0];
+        _positionsY[i] = position[1];
+        _positionsZ[i] = position[2];
+    }
+
+    // Trees that haven't been built yet are built over the new positions
+    // by prepare. The index buffers of built ones are already in leaf
+    // order, so triangle i is slot i.
+    if (_treeBuilt) {
+        std::vector<AABB> triangleBounds(_faceCount);
+        for (size_t i = 0; i < _faceCount; i++) {
+            triangleBounds[i] = getTriangleBounds(i);
+        }
+        refitBounds(triangleBounds);
+        if (refitCostRatio() > _bvhSettings.maxRefitCostRatio) {
+            buildTree();
+        }
+    }
+
+    // Only refresh the light sampling distribution if it has been built
+    if (!_areaCdf.empty()) {
+        double totalArea = 0;
+        for (size_t i = 0; i < _faceCount; i++) {
+            totalArea += 0.5 * getFaceNormal(i).length();
+            _areaCdf[i] = totalArea;
+        }
+    }
+}
+
+bool
+Mesh::intersectTriangle(
+    size_t triangle, const Ray &r, double t_min, double t_max, double &t,
+    double &b1, double &b2) const
+{
+    const int *index = &_positionIndices[triangle * 3];
+    Vec3 v0 = getPosition(index[0]);
+    Vec3 edge1 = getPosition(index[1]) - v0;
+    Vec3 edge2 = getPosition(index[2]) - v0;
+
+    Vec3 pvec = cross(r.direction(), edge2);
+    double det = dot(edge1, pvec);
+    // Return if ray is parallel with triangle
+    if (det == 0) {
+        return false;
+    }
+    double invDet = 1 / det;
+
+    Vec3 tvec = r.origin() - v0;
+    b1 = dot(tvec, pvec) * invDet;
+    if (b1 < 0 || b1 > 1) {
+        return false;
+    }
+
+    Vec3 qvec = cross(tvec, edge1);
+    b2 = dot(r.direction(), qvec) * invDet;
+    if (b2 < 0 || b1 + b2 > 1) {
+        return false;
+    }
+
+    // Don't report hits outside the range
+    t = dot(edge2, qvec) * invDet;
+    return t >= t_min && t <= t_max;
+}
+
+bool
+Mesh::hitPrimitives(
+    uint32_t first, uint32_t count, const Ray &r, double t_min, double t_max,
+    hit_record &rec) const
+{
+    // Only the triangle and its barycentrics are recorded here. The rest of
+    // rec is filled in by hit once the closest triangle is known.
+    bool hitAnything = false;
+    for (uint32_t i = first; i < first + count; ++i) {
+        double t, b1, b2;
+        if (intersectTriangle(i, r, t_min, t_max, t, b1, b2)) {
+            hitAnything = true;
+            t_max = t;
+            rec.t = t;
+            rec.u = b1;
+            rec.v = b2;
+            rec.primitiveIndex = i;
+        }
+    }
+    return hitAnything;
+}
+
+bool
+Mesh::occludedPrimitives(
+    uint32_t first, uint32_t count, const Ray &r, double t_min,
+    double t_max) const
+{
+    for (uint32_t i = first; i < first + count; ++i) {
+        double t, b1, b2;
+        if (intersectTriangle(i, r, t_min, t_max, t, b1, b2)) return true;
+    }
+    return false;
+}
+
+bool
+Mesh::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    if (!BVHTree::hit(r, t_min, t_max, rec)) {
+        return false;
+    }
+
+    size_t offset = rec.primitiveIndex * 3;
+    double w[3] = {1 - rec.u - rec.v, rec.u, rec.v};
+    rec.p = r.at(rec.t);
+    rec.mat = mat.get();
+    rec.object = this;
+
+    if (_uvsDefined) {
+        const GeomReal *uv0 = &_uvs[_uvIndices[offset] * 2];
+        const GeomReal *uv1 = &_uvs[_uvIndices[offset + 1] * 2];
+        const GeomReal *uv2 = &_uvs[_uvIndices[offset + 2] * 2];
+        rec.u = uv0[0] * w[0] + uv1[0] * w[1] + uv2[0] * w[2];
+        rec.v = uv0[1] * w[0] + uv1[1] * w[1] + uv2[1] * w[2];
+    } else {
+        rec.u = 0;
+        rec.v = 0;
+    }
+
+    if (_normalsDefined && smoothShading) {
+        Vec3 n0 = getNormal(_normalIndices[offset]);
+        Vec3 n1 = getNormal(_normalIndices[offset + 1]);
+        Vec3 n2 = getNormal(_normalIndices[offset + 2]);
+        rec.set_face_normal(r, unit_vector(w[0] * n0 + w[1] * n1 + w[2] * n2));
+    } else {
+        rec.set_face_normal(r, unit_vector(getFaceNormal(rec.primitiveIndex)));
+    }
+
+    return true;
+}
+
+Vec3
+Mesh::getFaceNormal(size_t triangle) const
+{
+    const int *index = &_positionIndices[triangle * 3];
+    Vec3 v0 = getPosition(index[0]);
+    return cross(getPosition(index[1]) - v0, getPosition(index[2]) - v0);
+}
+
+void
+Mesh::buildAreaDistribution() const
+{
+    std::call_once(_areaDistributionBuilt, [this]() {
+        _areaCdf.resize(_faceCount);
+        double totalArea = 0;
+        for (size_t i = 0; i < _faceCount; i++) {
+            totalArea += 0.5 * getFaceNormal(i).length();
+            _areaCdf[i] = totalArea;
+        }
+    });
+}
+
+double
+Mesh::pdf_value(const Point3 &o, const Vec3 &direction) const
+{
+    hit_record rec;
+    if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
+        return 0;
+    }
+
+    buildAreaDistribution();
+    double area = _areaCdf.back();
+    double distanceSquared = rec.t * rec.t * direction.length_squared();
+    Vec3 normal = unit_vector(getFaceNormal(rec.primitiveIndex));
+    double cosine = fabs(dot(direction, normal) / direction.length());
+
+    return distanceSquared / (cosine * area);
+}
+
+Vec3
+Mesh::random(const Vec3 &o, Sampler &sampler) const
+{
+    if (_faceCount == 0) {
+        return Vec3(1, 0, 0);
+    }
+    buildAreaDistribution();
+
+    // Pick a triangle proportionally to its area, then reuse what is left
+    // of the sample to place the point within it
+    double totalArea = _areaCdf.back();
+    double target = sampler.getDouble() * totalArea;
+    size_t triangle
+        = std::upper_bound(_areaCdf.begin(), _areaCdf.end(), target)
+        - _areaCdf.begin();
+    triangle = std::min(triangle, _faceCount - 1);
+    double areaBelow = triangle > 0 ? _areaCdf[triangle - 1] : 0;
+    double remapped = (target - areaBelow) / (_areaCdf[triangle] - areaBelow);
+
+    // Uniformly sample the triangle's area
+    const int *index = &_positionIndices[triangle * 3];
+    Vec3 v0 = getPosition(index[0]);
+    double su = sqrt(fmin(remapped, 1.0));
+    double b1 = sampler.getDouble() * su;
+    double b2 = su - b1;
+    Point3 randomPoint = v0 + b1 * (getPosition(index[1]) - v0)
+                       + b2 * (getPosition(index[2]) - v0);
+    return unit_vector(randomPoint - o);
 }
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
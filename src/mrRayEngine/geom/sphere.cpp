@@ -1,6 +1,8 @@
 #include "mrRay/geom/sphere.h"
 #include <iostream>
 
+#include "mrRay/onb.h"
+
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
 bool
@@ -27,6 +29,7 @@ Sphere::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
             rec.set_face_normal(r, outward_normal);
             get_sphere_uv((rec.p - center) / radius, rec.u, rec.v);
             rec.mat = mat.get();
+            rec.object = this;
             return true;
         }
 
@@ -38,6 +41,7 @@ Sphere::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
             rec.set_face_normal(r, outward_normal);
             get_sphere_uv((rec.p - center) / radius, rec.u, rec.v);
             rec.mat = mat.get();
+            rec.object = this;
             return true;
         }
     }
@@ -46,6 +50,23 @@ Sphere::hit(const Ray &r, double t_min, double t_max, hit_record &rec) const
     return false;
 }
 
+bool
+Sphere::occluded(const Ray &r, double t_min, double t_max) const
+{
+    Vec3 oc = r.origin() - center;
+    double a = dot(r.direction(), r.direction());
+    double b = 2.0 * dot(oc, r.direction());
+    double c = dot(oc, oc) - radius * radius;
+    double discriminant = (b * b) - (4 * a * c);
+    if (discriminant <= 0) return false;
+
+    double root = sqrt(discriminant);
+    double temp = (-b - root) / (2 * a);
+    if (temp < t_max && temp > t_min) return true;
+    temp = (-b + root) / (2 * a);
+    return temp < t_max && temp > t_min;
+}
+
 void
 Sphere::get_sphere_uv(const Vec3 &p, double &u, double &v)
 {
@@ -64,4 +85,39 @@ Sphere::bounding_box(double time0, double time1, AABB &output_box) const
     return true;
 }
 
+double
+Sphere::pdf_value(const Point3 &o, const Vec3 &direction) const
+{
+    hit_record rec;
+    if (!this->hit(Ray(o, direction), 0, infinity, rec)) {
+        return 0;
+    }
+
+    // Directions are sampled uniformly over the cone the sphere subtends.
+    // There is no such cone from inside the sphere, so it can't be sampled
+    double distanceSquared = (center - o).length_squared();
+    if (distanceSquared <= radius * radius) return 0;
+    double cosThetaMax = sqrt(1 - radius * radius / distanceSquared);
+    double solidAngle = 2 * pi * (1 - cosThetaMax);
+
+    return 1 / solidAngle;
+}
+
+Vec3
+Sphere::random(const Vec3 &o, Sampler &sampler) const
+{
+    Vec3 direction = center - o;
+    double distanceSquared = direction.length_squared();
+    if (distanceSquared <= radius * radius) return unit_vector(direction);
+
+    double cosThetaMax = sqrt(1 - radius * radius / distanceSquared);
+    double z = 1 + sampler.getDouble() * (cosThetaMax - 1);
+    double phi = 2 * pi * sampler.getDouble();
+    double sinTheta = sqrt(1 - z * z);
+
+    ONB uvw;
+    uvw.buildFromW(direction);
+    return uvw.local(cos(phi) * sinTheta, sin(phi) * sinTheta, z);
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,96 @@
+#include "mrRay/matrix.h"
+
+#include <algorithm>
+#include <cmath>
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+Mat4
+Mat4::operator*(const Mat4 &other) const
+{
+    double result[16];
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            double sum = 0;
+            for (int k = 0; k < 4; k++) {
+                sum += _data[row * 4 + k] * other._data[k * 4 + col];
+            }
+            result[row * 4 + col] = sum;
+        }
+    }
+    return Mat4(
+        result[0],
+        result[1],
+        result[2],
+        result[3],
+        result[4],
+        result[5],
+        result[6],
+        result[7],
+        result[8],
+        result[9],
+        result[10],
+        result[11],
+        result[12],
+        result[13],
+        result[14],
+        result[15]);
+}
+
+Mat4
+Mat4::inverse() const
+{
+    // Gauss-Jordan elimination with partial pivoting on [this | identity]
+    double a[4][8];
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            a[row][col] = _data[row * 4 + col];
+            a[row][col + 4] = row == col ? 1 : 0;
+        }
+    }
+
+    for (int col = 0; col < 4; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 4; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+        }
+        if (a[pivot][col] == 0) return identity();
+        if (pivot != col) {
+            for (int k = 0; k < 8; k++) {
+                std::swap(a[col][k], a[pivot][k]);
+            }
+        }
+
+        double scale = 1 / a[col][col];
+        for (int k = 0; k < 8; k++) {
+            a[col][k] *= scale;
+        }
+        for (int row = 0; row < 4; row++) {
+            if (row == col || a[row][col] == 0) continue;
+            double factor = a[row][col];
+            for (int k = 0; k < 8; k++) {
+                a[row][k] -= factor * a[col][k];
+            }
+        }
+    }
+
+    return Mat4(
+        a[0][4],
+        a[0][5],
+        a[0][6],
+        a[0][7],
+        a[1][4],
+        a[1][5],
+        a[1][6],
+        a[1][7],
+        a[2][4],
+        a[2][5],
+        a[2][6],
+        a[2][7],
+        a[3][4],
+        a[3][5],
+        a[3][6],
+        a[3][7]);
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
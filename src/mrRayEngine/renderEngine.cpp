@@ -1,5 +1,7 @@
 #include "mrRay/renderEngine.h"
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 #include <vector>
 
@@ -8,112 +10,275 @@
 #include "mrRay/pdf.h"
 #include "mrRay/timer.h"
 
-#define MAX_DEPTH 12
-
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
-Colour
-rayColourHelper(
-    const Ray &r, const Scene &scene, MemoryArena &arena, Sampler &sampler,
-    int depth)
+// Sampler dimensions used by the camera ray: pixel position and lens
+const unsigned int CAMERA_DIMENSIONS = 4;
+// Sampler dimensions used by each bounce, relative to the bounce's first
+const unsigned int BOUNCE_DIMENSIONS = 8;
+const unsigned int SCATTER_DIMENSION = 0;
+// Light choice followed by the point on the light
+const unsigned int LIGHT_DIMENSION = 1;
+const unsigned int ROULETTE_DIMENSION = 4;
+const unsigned int BSDF_DIMENSION = 6;
+// Fraction of a shadow ray cut from its far end, so the light it ends on
+// doesn't count as an occluder
+const double SHADOW_EPSILON = 0.0001;
+// How often execute calls the poll callback while the render threads run
+const std::chrono::milliseconds POLL_INTERVAL(5);
+// Checkpoints are only written between passes, so renders that checkpoint
+// take passes of this many samples when no pass size is given
+const unsigned int CHECKPOINT_PASS_SAMPLES = 4;
+
+// Power heuristic weight for multiple importance sampling with one sample
+// from each strategy
+inline double
+powerHeuristic(double pdf, double otherPdf)
 {
-    // Rays that bounce between white objects may never terminate
-    // from the russian roulette process, this is a fail-safe
-    if (depth > MAX_DEPTH) {
-        return Colour(0, 0, 0);
-    }
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
 
-    // If the ray hits nothing, return the skybox colour
-    hit_record rec;
-    if (!scene.getWorld()->hit(r, 0.001, infinity, rec)) {
-        // Compute u,v of hit
-        double u, v;
-        Sphere::get_sphere_uv(unit_vector(r.direction()), u, v);
-        return scene.getSkyboxTexture()->value(u, v, rec);
-    }
+// Returns the light arriving at rec from a light picked from the scene,
+// weighted against the chance of the material's PDF finding it instead
+Colour
+sampleDirectLight(
+    const Ray &r, const hit_record &rec, const scatter_record &srec,
+    const Scene &scene, Sampler &sampler)
+{
+    const Hittable *light = scene.sampleLight(sampler);
+    if (!light) return Colour(0, 0, 0);
 
-    Colour emitted = rec.mat->emitted(0, 0, Vec3(0, 0, 0));
-    scatter_record srec;
-    if (!rec.mat->scatter(r, rec, srec, arena)) return emitted;
+    Vec3 direction = light->random(rec.p, sampler);
+    double cosine = dot(rec.normal, direction);
+    if (cosine <= 0) return Colour(0, 0, 0);
+    Ray shadowRay = rec.spawnRay(direction);
+    double lightPdf = scene.lightPdf(light, shadowRay.origin(), direction);
+    if (lightPdf <= 0) return Colour(0, 0, 0);
 
-    // If the generated ray is specular, then we do not need to sample directions
-    // (this is because the specular only has one possible scattering ray)
-    if (srec.isSpecular) {
-        return srec.attenuation
-             * rayColourHelper(srec.specularRay, scene, arena, sampler, depth)
-             * dot(rec.normal, srec.specularRay.direction());
-    }
-
-    // Determine russian roulette termination
-    float pContinue = 1 - (srec.attenuation.length() / sqrt(3));
-    pContinue = pContinue < 0 ? 0 : pContinue;
-    float invpContinue = 1 / (1 - pContinue);
-    float randomRussian = sampler.getDouble();
-    if (randomRussian < pContinue) {
+    // Shadow ray: anything closer than the sampled light blocks it
+    hit_record lightRec;
+    if (!light->hit(shadowRay, 0, infinity, lightRec)) {
         return Colour(0, 0, 0);
     }
-
-    // Generate sample direction
-    double pdf = 0;
-    Ray scattered;
-    while (pdf == 0) {
-        scattered = Ray(rec.p, srec.PDF_ptr->generate(sampler));
-        pdf = srec.PDF_ptr->value(scattered.direction());
+    if (scene.getWorld()->occluded(
+            shadowRay, 0, lightRec.t * (1 - SHADOW_EPSILON)))
+    {
+        return Colour(0, 0, 0);
     }
 
-    // Recursively scatter rays
-    return emitted
-         + srec.attenuation * rec.mat->bsdf(r, rec, scattered)
-               * dot(rec.normal, scattered.direction())
-               * rayColourHelper(scattered, scene, arena, sampler, depth + 1)
-               * invpContinue / pdf;
+    Colour emitted = lightRec.mat->emitted(lightRec.u, lightRec.v, lightRec.p);
+    double weight = powerHeuristic(lightPdf, srec.PDF_ptr->value(direction));
+    return emitted * srec.attenuation * rec.mat->bsdf(r, rec, shadowRay)
+         * cosine * weight / lightPdf;
 }
 
 Colour
-ray_colour(const Ray &r, const Scene &scene, MemoryArena &arena, Sampler &sampler)
+ray_colour(
+    const Ray &r, const Scene &scene, MemoryArena &arena, Sampler &sampler,
+    unsigned int maxDepth)
 {
-    return rayColourHelper(r, scene, arena, sampler, 0);
+    Colour radiance(0, 0, 0);
+    // Product of all the bsdf/pdf weights along the path so far
+    Colour throughput(1, 1, 1);
+    Ray ray = r;
+    // Emission found by a diffuse bounce was also sampled by the light
+    // sampling at that bounce, so it is weighted against it
+    bool diffuseBounce = false;
+    Point3 bounceOrigin;
+    double bouncePdf = 0;
+
+    // Rays that bounce between white objects may never terminate
+    // from the russian roulette process, maxDepth is a fail-safe
+    for (unsigned int depth = 0; depth <= maxDepth; ++depth) {
+        // If the ray hits nothing, add the skybox colour
+        hit_record rec;
+        if (!scene.getWorld()->hit(ray, 0, infinity, rec)) {
+            // Compute u,v of hit
+            double u, v;
+            Sphere::get_sphere_uv(unit_vector(ray.direction()), u, v);
+            radiance += throughput * scene.getSkyboxTexture()->value(u, v, rec);
+            break;
+        }
+
+        Colour emitted = rec.mat->emitted(rec.u, rec.v, rec.p);
+        if (diffuseBounce) {
+            double lightPdf
+                = scene.lightPdf(rec.object, bounceOrigin, ray.direction());
+            emitted = emitted * powerHeuristic(bouncePdf, lightPdf);
+        }
+        radiance += throughput * emitted;
+
+        unsigned int dimension = CAMERA_DIMENSIONS + depth * BOUNCE_DIMENSIONS;
+        sampler.setDimension(dimension + SCATTER_DIMENSION);
+        scatter_record srec;
+        if (!rec.mat->scatter(ray, rec, srec, arena, sampler)) break;
+
+        // If the generated ray is specular, then we do not need to sample
+        // directions (this is because the specular only has one possible
+        // scattering ray)
+        if (srec.isSpecular) {
+            throughput = throughput * srec.attenuation;
+            ray = srec.specularRay;
+            diffuseBounce = false;
+            continue;
+        }
+
+        sampler.setDimension(dimension + LIGHT_DIMENSION);
+        radiance
+            += throughput * sampleDirectLight(ray, rec, srec, scene, sampler);
+
+        // Russian roulette on the path throughput, so paths only get cut
+        // once they can no longer contribute much
+        double pSurvive = std::min(
+            1.0, std::max({throughput[0], throughput[1], throughput[2]}));
+        sampler.setDimension(dimension + ROULETTE_DIMENSION);
+        if (sampler.getDouble() >= pSurvive) break;
+        throughput = throughput / pSurvive;
+
+        // Generate sample direction
+        sampler.setDimension(dimension + BSDF_DIMENSION);
+        double pdf = 0;
+        Ray scattered;
+        while (pdf == 0) {
+            scattered = rec.spawnRay(srec.PDF_ptr->generate(sampler));
+            pdf = srec.PDF_ptr->value(scattered.direction());
+        }
+
+        throughput = throughput * srec.attenuation
+                   * rec.mat->bsdf(ray, rec, scattered)
+                   * dot(rec.normal, scattered.direction()) / pdf;
+        ray = scattered;
+        diffuseBounce = true;
+        bounceOrigin = scattered.origin();
+        bouncePdf = pdf;
+    }
+    return radiance;
 }
 
-void
-ExecutionBlock::execute(Scene *scene, const Tile &tile)
+bool
+ExecutionBlock::execute(
+    Scene *scene, const Tile &tile, unsigned int samples, const Film &film,
+    const std::atomic<bool> &stopRequested)
 {
     Camera *mainCam = scene->getMainCam();
+    tileBuffer.reserve(tile);
     for (unsigned int j = tile.top; j < tile.top + tile.height; j++) {
         for (unsigned int i = tile.left; i < tile.left + tile.width; i++) {
+            unsigned int tileIndex = (j - tile.top) * tile.width + i - tile.left;
+            if (film.isConverged(i, j)) {
+                tileBuffer.colours[tileIndex] = Colour(0, 0, 0);
+                tileBuffer.luminanceSquares[tileIndex] = 0;
+                tileBuffer.sampleCounts[tileIndex] = 0;
+                continue;
+            }
+
             Colour pixel_colour(0, 0, 0);
-            for (unsigned int s = 0; s < renderSettings.samplesPerPixel; s++) {
-                double u = (i + sampler.getDouble())
+            double luminanceSquares = 0;
+            unsigned int firstSample = film.getSampleCount(i, j);
+            // Pixels can be ahead of the pass count when resuming from a
+            // checkpoint taken part way through a pass
+            unsigned int pixelSamples = 0;
+            if (firstSample < renderSettings.samplesPerPixel) {
+                pixelSamples = std::min(
+                    samples, renderSettings.samplesPerPixel - firstSample);
+            }
+            for (unsigned int s = 0; s < pixelSamples; s++) {
+                if (stopRequested.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                sampler->startPixelSample(i, j, firstSample + s);
+                double u = (i + sampler->getDouble())
                          / (renderSettings.imageWidth - 1.0);
-                double v = (j + sampler.getDouble())
+                double v = (j + sampler->getDouble())
                          / (renderSettings.imageHeight - 1.0);
-                Ray r = mainCam->getRay(u, v, sampler);
-                pixel_colour += ray_colour(r, *scene, arena, sampler);
+                Ray r = mainCam->getRay(u, v, *sampler);
+                Colour sample = ray_colour(
+                    r, *scene, arena, *sampler, renderSettings.maxDepth);
+                pixel_colour += sample;
+                luminanceSquares += luminance(sample) * luminance(sample);
             }
-            unsigned int tileIndex = (j - tile.top) * tile.width + i - tile.left;
-            tile.colours[tileIndex]
-                = pixel_colour / renderSettings.samplesPerPixel;
+            tileBuffer.colours[tileIndex] = pixel_colour;
+            tileBuffer.luminanceSquares[tileIndex] = luminanceSquares;
+            tileBuffer.sampleCounts[tileIndex] = pixelSamples;
         }
     }
+    return true;
 }
 
 void
-executeBlock(
-    std::shared_ptr<ExecutionBlock> block, Scene *scene,
-    std::shared_ptr<Film> film, std::shared_ptr<TilesQueue> tilesQueue)
+ExecutionBlock::configure(const RenderSettings &settings)
 {
-    Tile *tile = tilesQueue->getTile();
-    while (tile != nullptr) {
-        block->execute(scene, *tile);
-        film->writeTile(*tile);
-        tile = tilesQueue->getTile();
+    if (settings.samplerType != renderSettings.samplerType
+        || settings.frame != renderSettings.frame)
+    {
+        sampler = Sampler::create(settings.samplerType, settings.frame);
+    }
+    renderSettings = settings;
+}
+
+void
+RenderEngine::executeBlock(
+    ExecutionBlock *block, Scene *scene, TileScheduler *scheduler,
+    unsigned int samples)
+{
+    while (waitWhilePaused()) {
+        if (_hasDeadline && std::chrono::steady_clock::now() >= _deadline) {
+            break;
+        }
+        Tile *tile = scheduler->getTile(block->blockID);
+        if (!tile) break;
+        // A stopped tile only has some of its samples, so it is dropped
+        // rather than added to the film
+        bool finished
+            = block->execute(scene, *tile, samples, *_film, _stopRequested);
         block->arena.Reset();
+        if (!finished) break;
+        _film->addTile(*tile, block->tileBuffer);
+        if (_tileFinishedCallback) _tileFinishedCallback(*tile, *_film);
     }
 }
 
+bool
+RenderEngine::waitWhilePaused()
+{
+    if (!_paused) return !_stopRequested;
+    std::unique_lock<std::mutex> lock(_controlMutex);
+    _controlCondition.wait(lock, [this]() { return !_paused || _stopRequested; });
+    return !_stopRequested;
+}
+
 RenderEngine::RenderEngine()
     : _hasInitialized(false)
+    , _stopRequested(false)
+    , _hasDeadline(false)
+    , _paused(false)
+{
+}
+
+void
+RenderEngine::stop()
+{
+    std::lock_guard<std::mutex> lock(_controlMutex);
+    _stopRequested = true;
+    // Otherwise a later execute would start out paused with nothing left
+    // to resume it
+    _paused = false;
+    _controlCondition.notify_all();
+}
+
+void
+RenderEngine::pause()
 {
+    std::lock_guard<std::mutex> lock(_controlMutex);
+    _paused = true;
+}
+
+void
+RenderEngine::resume()
+{
+    std::lock_guard<std::mutex> lock(_controlMutex);
+    _paused = false;
+    _controlCondition.notify_all();
 }
 
 RenderEngine::~RenderEngine()
@@ -127,7 +292,7 @@ RenderEngine::init(const RenderSettings &renderSettings)
         renderSettings.imageWidth, renderSettings.imageHeight);
 
     unsigned int tileSize = renderSettings.tileSize;
-    _tilesQueue = std::make_shared<TilesQueue>();
+    _tiles.clear();
 
     unsigned int remainingHeight = _film->height;
     while (remainingHeight > 0) {
@@ -137,11 +302,11 @@ RenderEngine::init(const RenderSettings &renderSettings)
         while (remainingWidth > 0) {
             unsigned int width
                 = remainingWidth > tileSize ? tileSize : remainingWidth;
-            _tilesQueue->addTile(std::make_shared<Tile>(
+            _tiles.emplace_back(
                 _film->height - remainingHeight,
                 _film->width - remainingWidth,
                 width,
-                height));
+                height);
             remainingWidth -= width;
         }
         remainingHeight -= height;
@@ -150,9 +315,37 @@ RenderEngine::init(const RenderSettings &renderSettings)
     _hasInitialized = true;
 }
 
+void
+RenderEngine::prepareThreads(const RenderSettings &renderSettings)
+{
+    unsigned int threadCount = std::max(renderSettings.threads, 1u);
+    if (!_threadPool || _threadPool->size() != threadCount
+        || _threadPool->pinned() != renderSettings.pinThreads)
+    {
+        _threadPool.reset();
+        _threadPool = std::make_unique<ThreadPool>(
+            threadCount, renderSettings.pinThreads);
+    }
+
+    // Blocks are reused by every render so their arenas are only set up
+    // once
+    _blocks.resize(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        if (_blocks[i]) {
+            _blocks[i]->configure(renderSettings);
+        } else {
+            _blocks[i] = std::make_unique<ExecutionBlock>(i, renderSettings);
+        }
+    }
+}
+
 void
 RenderEngine::execute(const RenderSettings &renderSettings, Scene *scene)
 {
+    // Reset before anything else, so a stop from another thread during
+    // scene init is not lost
+    _stopRequested = false;
+
     if (!_hasInitialized) {
         std::cerr << "RenderEngine execution called before init" << std::endl;
         return;
@@ -163,21 +356,150 @@ RenderEngine::execute(const RenderSettings &renderSettings, Scene *scene)
         return;
     }
 
+    using Clock = std::chrono::steady_clock;
+    bool budgeted = renderSettings.timeBudget > 0;
+    _hasDeadline = budgeted;
+    _deadline = Clock::now()
+              + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(renderSettings.timeBudget));
+
+    if (_stopRequested) return;
     {
         Timer timer("scene init");
-        scene->init();
+        BVHSettings bvhSettings;
+        bvhSettings.buildThreads = renderSettings.threads;
+        scene->init(bvhSettings);
+    }
+    if (_stopRequested) return;
+
+    _film->clear();
+    bool checkpointing = !renderSettings.checkpointPath.empty();
+    if (checkpointing && renderSettings.resume
+        && _film->readCheckpoint(
+            renderSettings.checkpointPath,
+            renderSettings.samplerType,
+            renderSettings.frame))
+    {
+        std::cout << "Resuming from checkpoint: "
+                  << renderSettings.checkpointPath << std::endl;
     }
 
-    std::vector<std::thread> threads(renderSettings.threads);
-    for (size_t i = 0; i < renderSettings.threads; ++i) {
-        std::shared_ptr<ExecutionBlock> block
-            = std::make_shared<ExecutionBlock>(i, renderSettings);
-        threads[i] = std::thread(executeBlock, block, scene, _film, _tilesQueue);
+    std::shared_ptr<TileScheduler> scheduler = std::make_shared<TileScheduler>(
+        renderSettings.threads, renderSettings.minSplitTileSize);
+    std::vector<Tile *> tiles;
+    for (Tile &tile: _tiles) {
+        tiles.push_back(&tile);
     }
 
-    for (std::thread &thread: threads) {
-        thread.join();
+    prepareThreads(renderSettings);
+
+    // Adaptive sampling needs passes to test convergence between, so it
+    // defaults to passes of the minimum sample count
+    bool adaptive = renderSettings.noiseThreshold > 0;
+    unsigned int samplesPerPass = renderSettings.samplesPerPixel;
+    if (renderSettings.samplesPerPass > 0) {
+        samplesPerPass = renderSettings.samplesPerPass;
+    } else if (adaptive) {
+        samplesPerPass = std::max(renderSettings.minSamplesPerPixel, 1u);
+    }
+    // Without a pass size, budgeted renders start with a single sample,
+    // which also measures how long a sample takes, and the passes double
+    // from there. That keeps the image progressing however short the
+    // budget is.
+    bool growPasses = budgeted && renderSettings.samplesPerPass == 0
+                   && !adaptive;
+    if (growPasses) {
+        samplesPerPass = 1;
+    } else if (checkpointing && renderSettings.samplesPerPass == 0) {
+        samplesPerPass = std::min(samplesPerPass, CHECKPOINT_PASS_SAMPLES);
+    }
+    double secondsPerPixelSample = 0;
+    Clock::time_point lastCheckpoint = Clock::now();
+    auto writeCheckpoint = [&]() {
+        _film->writeCheckpoint(
+            renderSettings.checkpointPath,
+            renderSettings.samplerType,
+            renderSettings.frame);
+        lastCheckpoint = Clock::now();
+    };
+
+    // A resumed film carries on from the pixels with the fewest samples
+    unsigned int samplesTaken
+        = std::min(_film->minSampleCount(), renderSettings.samplesPerPixel);
+    while (samplesTaken < renderSettings.samplesPerPixel && !_stopRequested) {
+        if (budgeted && Clock::now() >= _deadline) break;
+        unsigned int samples = std::min(
+            samplesPerPass, renderSettings.samplesPerPixel - samplesTaken);
+
+        // Only tiles with pixels left to converge get rendered again
+        std::vector<Tile *> pendingTiles;
+        size_t pendingPixels = 0;
+        for (Tile *tile: tiles) {
+            if (_film->isConverged(*tile)) continue;
+            pendingTiles.push_back(tile);
+            pendingPixels += (size_t)tile->width * tile->height;
+        }
+        if (pendingTiles.empty()) break;
+        scheduler->schedule(pendingTiles);
+
+        // Take as many samples as are expected to fit in the time left. A
+        // pass that overruns is cut short at the deadline anyway.
+        if (budgeted && secondsPerPixelSample > 0) {
+            double remaining
+                = std::chrono::duration<double>(_deadline - Clock::now())
+                      .count();
+            double fit = remaining / (secondsPerPixelSample * pendingPixels);
+            unsigned int limit = growPasses ? 2 * samplesPerPass : samples;
+            limit = std::min(
+                limit, renderSettings.samplesPerPixel - samplesTaken);
+            samples = (unsigned int)std::max(1.0, std::min(fit, (double)limit));
+            if (growPasses) samplesPerPass = samples;
+        }
+        Clock::time_point passStart = Clock::now();
+
+        _threadPool->dispatch([&](unsigned int worker) {
+            executeBlock(_blocks[worker].get(), scene, scheduler.get(), samples);
+        });
+
+        // Poll while the pass runs, so the caller can stop or pause it
+        // from this thread
+        if (_pollCallback) {
+            while (!_threadPool->wait(POLL_INTERVAL)) {
+                _pollCallback();
+            }
+        } else {
+            _threadPool->wait();
+        }
+        // A stopped pass is incomplete, so it is not counted
+        if (_stopRequested) break;
+        if (budgeted && Clock::now() >= _deadline) break;
+
+        double passSeconds
+            = std::chrono::duration<double>(Clock::now() - passStart).count();
+        secondsPerPixelSample = passSeconds / ((double)samples * pendingPixels);
+        samplesTaken += samples;
+        if (adaptive) {
+            for (Tile *tile: pendingTiles) {
+                _film->updateConvergence(
+                    *tile,
+                    renderSettings.noiseThreshold,
+                    renderSettings.minSamplesPerPixel);
+            }
+        }
+        if (_passFinishedCallback) _passFinishedCallback(samplesTaken);
+
+        if (checkpointing
+            && std::chrono::duration<double>(Clock::now() - lastCheckpoint)
+                       .count()
+                   >= renderSettings.checkpointInterval)
+        {
+            writeCheckpoint();
+        }
     }
+
+    // Stopped passes only leave whole tiles in the film, so the film is
+    // always in a state that can be resumed from
+    if (checkpointing) writeCheckpoint();
 }
 
 MR_RAY_NAMESPACE_CLOSE_SCOPE
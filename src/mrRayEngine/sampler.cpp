@@ -0,0 +1,81 @@
+#include "mrRay/sampler.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+std::unique_ptr<Sampler>
+Sampler::create(SamplerType type, uint64_t seed)
+{
+    if (type == SamplerType::Sobol) return std::make_unique<SobolSampler>(seed);
+    return std::make_unique<IndependentSampler>(seed);
+}
+
+static inline uint32_t
+reverseBits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+// Hash based Owen scrambling, from Burley's "Practical Hash-based Owen
+// Scrambling". Every bit is flipped depending only on the bits above it.
+static inline uint32_t
+owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// First two dimensions of the Sobol sequence as 32 bit fractions. The
+// first is the van der Corput sequence. The second sets output digit d to
+// the parity of the index bits whose positions are supersets of d's bits,
+// which is computed in one step per bit of the position.
+static inline uint32_t
+sobol(uint32_t index, unsigned int dimension)
+{
+    if (dimension == 1) {
+        index ^= (index >> 1) & 0x55555555;
+        index ^= (index >> 2) & 0x33333333;
+        index ^= (index >> 4) & 0x0f0f0f0f;
+        index ^= (index >> 8) & 0x00ff00ff;
+        index ^= (index >> 16) & 0x0000ffff;
+    }
+    return reverseBits(index);
+}
+
+void
+SobolSampler::startPixelSample(
+    unsigned int x, unsigned int y, unsigned int index)
+{
+    pixelSeed = mix(mix(mix(seed) ^ x) ^ y);
+    this->index = index;
+    dimension = 0;
+    cachedPair = ~0u;
+}
+
+double
+SobolSampler::getDouble()
+{
+    unsigned int pair = dimension / 2;
+    unsigned int component = dimension % 2;
+    ++dimension;
+
+    if (pair != cachedPair) {
+        cachedPair = pair;
+        pairSeed = mix(pixelSeed ^ pair);
+        shuffledIndex = owenScramble(index, (uint32_t)pairSeed);
+    }
+    uint32_t value = owenScramble(
+        sobol(shuffledIndex, component), (uint32_t)(pairSeed >> 32) + component);
+    return value * 0x1p-32;
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
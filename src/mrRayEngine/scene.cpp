@@ -1,48 +1,149 @@
 #include "mrRay/scene.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "mrRay/material/material.h"
 
-#include "mrRay/geom/bvhNode.h"
-
 MR_RAY_NAMESPACE_OPEN_SCOPE
 
 Scene::Scene()
     : _mainCamera(nullptr)
     , _skyboxTexture(std::make_shared<SolidColour>(0, 0, 0))
-    , _rawHittables(std::make_shared<HittableList>())
-    , _hittableListDirty(false)
+    , _nextHandle(INVALID_HITTABLE_HANDLE + 1)
+    , _groupsDirty(true)
+    , _boundsDirty(false)
     , _sceneMutex()
 {
 }
 
 void
-Scene::init()
+Scene::init(const BVHSettings &bvhSettings)
+{
+    std::lock_guard<std::recursive_mutex> lock(_sceneMutex);
+    bool settingsChanged = bvhSettings != _bvhSettings;
+    bool groupRebuilt = false;
+    for (auto &entry: _groups) {
+        HittableGroup &group = entry.second;
+        if (group.dirty || settingsChanged) {
+            buildGroup(group, bvhSettings);
+            groupRebuilt = true;
+        } else if (group.boundsDirty && group.bvh) {
+            group.bvh->refit();
+            if (group.bvh->refitCostRatio() > bvhSettings.maxRefitCostRatio) {
+                buildGroup(group, bvhSettings);
+                groupRebuilt = true;
+            }
+        }
+        group.boundsDirty = false;
+    }
+
+    if (_groupsDirty || settingsChanged || groupRebuilt) {
+        rebuild(bvhSettings);
+    } else if (_boundsDirty) {
+        _world->refit();
+        _boundsDirty = false;
+        if (_world->refitCostRatio() > bvhSettings.maxRefitCostRatio) {
+            rebuild(bvhSettings);
+        }
+    }
+}
+
+void
+Scene::buildGroup(HittableGroup &group, const BVHSettings &bvhSettings)
 {
-    if (_hittableListDirty) {
-        // On small scales, a BVH will perform worse; however, on
-        // the larger scale, it is a lot faster
-        _world = std::make_shared<BVHNode>(*_rawHittables, 0, 0);
-        _hittableListDirty = false;
+    // Hittables with trees of their own, such as meshes, build them first
+    // so their bounds are known
+    for (const std::shared_ptr<Hittable> &hittable: group.hittables) {
+        hittable->prepare(bvhSettings);
+    }
+    if (group.hittables.size() <= 1) {
+        group.bvh = nullptr;
+        group.root = group.hittables.empty() ? nullptr : group.hittables[0];
+    } else {
+        group.bvh = std::make_shared<BVH>(group.hittables, bvhSettings);
+        group.root = group.bvh;
     }
+    group.dirty = false;
 }
 
 void
+Scene::rebuild(const BVHSettings &bvhSettings)
+{
+    std::vector<std::shared_ptr<Hittable>> roots;
+    roots.reserve(_groups.size());
+    for (const auto &entry: _groups) {
+        if (entry.second.root) roots.push_back(entry.second.root);
+    }
+
+    // On small scales, a BVH will perform worse; however, on
+    // the larger scale, it is a lot faster
+    _world = std::make_shared<BVH>(roots, bvhSettings);
+    _bvhSettings = bvhSettings;
+    _groupsDirty = false;
+    _boundsDirty = false;
+
+    _lights.clear();
+    _lightSet.clear();
+    for (const auto &entry: _groups) {
+        for (const std::shared_ptr<Hittable> &hittable: entry.second.hittables)
+        {
+            Material *mat = hittable->getMaterial();
+            if (!mat) continue;
+            Colour emitted = mat->emitted(0, 0, Vec3(0, 0, 0));
+            if (emitted[0] > 0 || emitted[1] > 0 || emitted[2] > 0) {
+                _lights.push_back(hittable.get());
+                _lightSet.insert(hittable.get());
+            }
+        }
+    }
+}
+
+HittableHandle
 Scene::addHittable(const std::shared_ptr<Hittable> &hittable)
+{
+    return addHittables(HittableList(hittable));
+}
+
+HittableHandle
+Scene::addHittables(const HittableList &hittableList)
 {
     std::lock_guard<std::recursive_mutex> lock(_sceneMutex);
-    _rawHittables->add(hittable);
-    _hittableListDirty = true;
+    HittableHandle handle = _nextHandle++;
+    _groups[handle].hittables = hittableList.objects;
+    _groupsDirty = true;
+    return handle;
 }
 
 void
-Scene::addHittables(const HittableList &hittableList)
+Scene::replaceHittables(
+    HittableHandle handle, const HittableList &hittableList)
 {
     std::lock_guard<std::recursive_mutex> lock(_sceneMutex);
-    for (auto const &hittable: hittableList.objects) {
-        this->addHittable(hittable);
-    }
+    auto it = _groups.find(handle);
+    if (it == _groups.end()) return;
+    it->second.hittables = hittableList.objects;
+    it->second.root = nullptr;
+    it->second.bvh = nullptr;
+    it->second.dirty = true;
+    _groupsDirty = true;
+}
+
+void
+Scene::removeHittables(HittableHandle handle)
+{
+    std::lock_guard<std::recursive_mutex> lock(_sceneMutex);
+    if (_groups.erase(handle) > 0) _groupsDirty = true;
+}
+
+void
+Scene::markBoundsDirty(HittableHandle handle)
+{
+    std::lock_guard<std::recursive_mutex> lock(_sceneMutex);
+    auto it = _groups.find(handle);
+    if (it == _groups.end()) return;
+    it->second.boundsDirty = true;
+    _boundsDirty = true;
 }
 
 Hittable *
@@ -51,4 +152,20 @@ Scene::getWorld() const
     return _world.get();
 }
 
+Hittable *
+Scene::sampleLight(Sampler &sampler) const
+{
+    if (_lights.empty()) return nullptr;
+    size_t index = (size_t)(sampler.getDouble() * _lights.size());
+    return _lights[std::min(index, _lights.size() - 1)];
+}
+
+double
+Scene::lightPdf(
+    const Hittable *object, const Point3 &o, const Vec3 &direction) const
+{
+    if (_lightSet.find(object) == _lightSet.end()) return 0;
+    return object->pdf_value(o, direction) / _lights.size();
+}
+
 MR_RAY_NAMESPACE_CLOSE_SCOPE
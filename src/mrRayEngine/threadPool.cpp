@@ -0,0 +1,96 @@
+#include "mrRay/threadPool.h"
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+ThreadPool::ThreadPool(unsigned int threadCount, bool pinThreads)
+    : _pinThreads(pinThreads)
+    , _generation(0)
+    , _pendingWorkers(0)
+    , _shutdown(false)
+{
+    threadCount = threadCount > 0 ? threadCount : 1;
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        _threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _shutdown = true;
+    }
+    _jobCondition.notify_all();
+    for (std::thread &thread: _threads) {
+        thread.join();
+    }
+}
+
+void
+ThreadPool::dispatch(const Job &job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = job;
+        _pendingWorkers = _threads.size();
+        ++_generation;
+    }
+    _jobCondition.notify_all();
+}
+
+void
+ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCondition.wait(lock, [this]() { return _pendingWorkers == 0; });
+}
+
+bool
+ThreadPool::wait(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _doneCondition.wait_for(
+        lock, timeout, [this]() { return _pendingWorkers == 0; });
+}
+
+void
+ThreadPool::workerLoop(unsigned int worker)
+{
+#if defined(__linux__)
+    if (_pinThreads) {
+        unsigned int cpuCount = std::thread::hardware_concurrency();
+        if (cpuCount > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(worker % cpuCount, &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+    }
+#endif
+
+    unsigned long generation = 0;
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobCondition.wait(lock, [&]() {
+                return _shutdown || _generation != generation;
+            });
+            if (_shutdown) return;
+            generation = _generation;
+            job = _job;
+        }
+
+        job(worker);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pendingWorkers == 0) _doneCondition.notify_all();
+    }
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE
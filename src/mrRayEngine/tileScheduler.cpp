@@ -0,0 +1,112 @@
+#include "mrRay/tileScheduler.h"
+
+MR_RAY_NAMESPACE_OPEN_SCOPE
+
+TileScheduler::TileScheduler(unsigned int workerCount, unsigned int minSplitSize)
+    : _minSplitSize(minSplitSize)
+    , _splitTilesUsed(0)
+{
+    workerCount = workerCount > 0 ? workerCount : 1;
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        _queues.push_back(std::make_unique<WorkerQueue>());
+    }
+}
+
+void
+TileScheduler::schedule(const std::vector<Tile *> &tiles)
+{
+    // Tiles made by splitting are only referenced by the queues, so they
+    // can be reused once the queues are replaced
+    {
+        std::lock_guard<std::mutex> lock(_splitTilesMutex);
+        _splitTilesUsed = 0;
+    }
+
+    // Give each worker a contiguous run of tiles
+    size_t workerCount = _queues.size();
+    for (size_t worker = 0; worker < workerCount; ++worker) {
+        size_t start = tiles.size() * worker / workerCount;
+        size_t end = tiles.size() * (worker + 1) / workerCount;
+        std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+        _queues[worker]->tiles.assign(
+            tiles.begin() + start, tiles.begin() + end);
+    }
+}
+
+Tile *
+TileScheduler::getTile(unsigned int worker)
+{
+    WorkerQueue &queue = *_queues[worker % _queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tiles.empty()) {
+            Tile *tile = queue.tiles.front();
+            queue.tiles.pop_front();
+            return tile;
+        }
+    }
+    return steal(worker % _queues.size());
+}
+
+Tile *
+TileScheduler::steal(unsigned int worker)
+{
+    // Victims are tried in order starting after this worker, which spreads
+    // thieves out over the other queues
+    for (size_t i = 1; i < _queues.size(); ++i) {
+        WorkerQueue &victim = *_queues[(worker + i) % _queues.size()];
+        Tile *tile = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tiles.empty()) continue;
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+        }
+        return split(tile, worker);
+    }
+    return nullptr;
+}
+
+Tile *
+TileScheduler::split(Tile *tile, unsigned int worker)
+{
+    if (_minSplitSize == 0) return tile;
+    bool splitWidth = tile->width >= tile->height;
+    unsigned int size = splitWidth ? tile->width : tile->height;
+    if (size < 2 * _minSplitSize) return tile;
+
+    unsigned int half = size / 2;
+    Tile *firstTile, *secondTile;
+    if (splitWidth) {
+        firstTile
+            = acquireSplitTile(tile->top, tile->left, half, tile->height);
+        secondTile = acquireSplitTile(
+            tile->top, tile->left + half, tile->width - half, tile->height);
+    } else {
+        firstTile = acquireSplitTile(tile->top, tile->left, tile->width, half);
+        secondTile = acquireSplitTile(
+            tile->top + half, tile->left, tile->width, tile->height - half);
+    }
+    {
+        WorkerQueue &queue = *_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tiles.push_back(secondTile);
+    }
+    return firstTile;
+}
+
+Tile *
+TileScheduler::acquireSplitTile(
+    unsigned int top, unsigned int left, unsigned int width,
+    unsigned int height)
+{
+    std::lock_guard<std::mutex> lock(_splitTilesMutex);
+    if (_splitTilesUsed == _splitTiles.size()) {
+        _splitTiles.emplace_back(top, left, width, height);
+    } else {
+        _splitTiles[_splitTilesUsed] = Tile(top, left, width, height);
+    }
+    return &_splitTiles[_splitTilesUsed++];
+}
+
+MR_RAY_NAMESPACE_CLOSE_SCOPE